@@ -0,0 +1,93 @@
+//===-- CallPath.h ----------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_CALLPATH_H
+#define KLEE_CALLPATH_H
+
+#include "klee/Constraints.h"
+#include "klee/Expr.h"
+
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace llvm {
+class MemoryBuffer;
+class raw_ostream;
+}
+
+namespace klee {
+class ArrayCache;
+
+namespace expr {
+class Parser;
+}
+
+/// One traced call of a call path, with the values of its arguments and
+/// extra pointers before and after the call. The values that were not
+/// traced are null.
+struct CallPathCall {
+  typedef std::pair<ref<Expr>, ref<Expr> > BeforeAfter;
+
+  std::string function_name;
+  std::map<std::string, BeforeAfter> args;
+  std::map<std::string, BeforeAfter> extra_vars;
+};
+
+/// A call path written by klee --dump-call-traces, as read back by the
+/// call path tools.
+struct CallPath {
+  ConstraintManager constraints;
+  std::vector<CallPathCall> calls;
+  std::map<std::string, const Array *> arrays;
+  /// The value of each extra variable before the first call that traced it.
+  std::map<std::string, ref<Expr> > initial_extra_vars;
+
+  CallPath();
+  ~CallPath();
+
+private:
+  friend class CallPathLoader;
+
+  /// The owners of the arrays: the parser of the kQuery, or the array
+  /// cache when the arrays were created directly.
+  expr::Parser *parser;
+  llvm::MemoryBuffer *buffer;
+  ArrayCache *arrayCache;
+
+  CallPath(const CallPath &);
+  CallPath &operator=(const CallPath &);
+};
+
+/// Load the call path in \a fileName, in the text, shared text or binary
+/// format. The kQuery \a exprStrs are parsed in the context of the call
+/// path and appended to \a exprs, in order. They may also refer to the
+/// arrays declared by \a symbols ("array name[size] : w32 -> w8 =
+/// symbolic"), which are only added if the call path does not declare
+/// them. Returns null and sets \a error if the file can not be read.
+CallPath *loadCallPath(const std::string &fileName,
+                       const std::set<std::string> &symbols,
+                       const std::vector<std::string> &exprStrs,
+                       std::deque<ref<Expr> > &exprs, std::string &error);
+
+CallPath *loadCallPath(const std::string &fileName, std::string &error);
+
+/// Write the \a calls and \a constraints of a call path in the binary
+/// format: a table of the arrays, followed by the expression DAG with
+/// every distinct subexpression and update node stored once, the calls
+/// and the constraints, all referring to the DAG by index.
+void writeBinaryCallPath(llvm::raw_ostream &os,
+                         const std::vector<CallPathCall> &calls,
+                         const ConstraintManager &constraints);
+}
+
+#endif
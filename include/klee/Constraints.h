@@ -26,14 +26,15 @@ public:
   typedef constraints_ty::iterator iterator;
   typedef constraints_ty::const_iterator const_iterator;
 
-  ConstraintManager() {}
+  ConstraintManager() : rewrites(0) {}
 
   // create from constraints with no optimization
   explicit
   ConstraintManager(const std::vector< ref<Expr> > &_constraints) :
-    constraints(_constraints) {}
+    constraints(_constraints), rewrites(0) {}
 
-  ConstraintManager(const ConstraintManager &cs) : constraints(cs.constraints) {}
+  ConstraintManager(const ConstraintManager &cs)
+    : constraints(cs.constraints), rewrites(cs.rewrites) {}
 
   typedef std::vector< ref<Expr> >::const_iterator constraint_iterator;
 
@@ -43,6 +44,7 @@ public:
 
   void clear() {
     constraints.clear();
+    ++rewrites;
   }
 
   ref<Expr> simplifyExpr(ref<Expr> e) const;
@@ -65,12 +67,19 @@ public:
     return constraints.size();
   }
 
+  // The number of times the existing constraints were rewritten by adding
+  // a constraint, or cleared, for the users that only index the new ones.
+  unsigned getRewrites() const {
+    return rewrites;
+  }
+
   bool operator==(const ConstraintManager &other) const {
     return constraints == other.constraints;
   }
   
 private:
   std::vector< ref<Expr> > constraints;
+  unsigned rewrites;
 
   // returns true iff the constraints were modified
   bool rewriteConstraints(ExprVisitor &visitor);
@@ -15,6 +15,8 @@
 #include "klee/Internal/ADT/TreeStream.h"
 #include "klee/MergeHandler.h"
 #include "klee/Internal/ADT/ImmutableSet.h"
+#include "klee/Internal/ADT/SharedPrefixList.h"
+#include "klee/util/ConstraintSlices.h"
 #include "klee/util/GetExprSymbols.h"
 #include "klee/LoopAnalysis.h"
 
@@ -25,6 +27,7 @@
 //TODO: generalize for otehr LLVM versions like the above
 #include <llvm/Analysis/LoopInfo.h>
 
+#include <cstdio>
 #include <map>
 #include <regex>
 #include <set>
@@ -95,6 +98,10 @@ struct FieldDescr {
 
   bool sameInvocationValue(const FieldDescr& other) const;
   bool eq(const FieldDescr& other) const;
+  // The hashes leave out the fields, eq() only checks that the fields of
+  // one side are in the other.
+  unsigned sameInvocationHash() const;
+  unsigned hash() const;
 };
 
 struct CallArg {
@@ -107,6 +114,8 @@ struct CallArg {
 
   bool eq(const CallArg& other) const;
   bool sameInvocationValue(const CallArg& other) const;
+  unsigned hash() const;
+  unsigned sameInvocationHash() const;
 };
 
 struct RetVal {
@@ -117,6 +126,7 @@ struct RetVal {
   FieldDescr pointee;
 
   bool eq(const RetVal& other) const;
+  unsigned hash() const;
 };
 
 struct CallExtraPtr {
@@ -129,6 +139,7 @@ struct CallExtraPtr {
 
   bool sameInvocationValue(const CallExtraPtr& other) const;
   bool eq(const CallExtraPtr& other) const;
+  unsigned hash() const;
 };
 
 //TODO: Store assumptions increment as well. it is an important part of the call
@@ -142,11 +153,26 @@ struct CallInfo {
   std::vector< ref<Expr> > callContext;
   std::vector< ref<Expr> > returnContext;
   llvm::DebugLoc callPlace;
+  /// The structural hashes, consistent with eq() and sameInvocation().
+  /// Only valid once the call returned, it does not change after that.
+  unsigned hashValue;
+  unsigned sameInvocationHashValue;
 
   CallArg* getCallArgPtrp(ref<Expr> ptr);
   bool eq(const CallInfo& other) const;
   bool sameInvocation(const CallInfo* other) const;
   SymbolSet computeRetSymbolSet() const;
+
+  unsigned computeHash() const;
+  unsigned computeSameInvocationHash() const;
+  /// Compute the hashes of a returned call.
+  void cacheHashes();
+  unsigned hash() const {
+    return returned ? hashValue : computeHash();
+  }
+  unsigned sameInvocationHash() const {
+    return returned ? sameInvocationHashValue : computeSameInvocationHash();
+  }
 };
 
 struct HavocInfo {
@@ -158,6 +184,13 @@ struct HavocInfo {
 
 class ExecutionState;
 
+/// @brief A path through the loop body explored in one round of the
+/// loop invariant analysis.
+struct LoopPath {
+  std::vector<bool> branches;
+  LoopPathReads reads;
+};
+
 /// @brief LoopInProcess keeps all the necessary information for
 /// dynamic loop invariant deduction.
 class LoopInProcess {
@@ -175,8 +208,35 @@ private:
   //Owner for the bitarrays.
   StateByteMask changedBytes;
   //std::set<const MemoryObject *> changedObjects;
+  /// In a worker process, the counters when the worker started.
+  LoopAnalysisProfile::Round workerStart;
+  std::vector<uint64_t> workerStartStats;
+
+  /// The number of rounds restarted with a forget mask so far.
+  unsigned round;
+  /// Whether another loop analysis was started inside this loop.
+  /// Incremental widening does not track the paths across it.
+  bool nestedAnalysis;
+  /// Whether some paths of the current round were explored by worker
+  /// processes, which do not report their branches.
+  bool pathsInWorkers;
+  /// The forget mask the current round started with. Owner for the bitarrays.
+  StateByteMask roundStartBytes;
+  /// The paths that finished in the current and in the previous round.
+  std::vector<LoopPath> roundPaths;
+  std::vector<LoopPath> lastRoundPaths;
+  /// Binary trie over the branches of lastRoundPaths. A node is affected
+  /// if some path through it read a byte forgotten for the current round.
+  struct PathNode {
+    int children[2];
+    bool affected;
+  };
+  std::vector<PathNode> lastRoundTrie;
+  LoopAnalysisProfile profile;
+  DiffMaskContext diffContext;
 
   ExecutionState *makeRestartState();
+  void prepareIncrementalRound();
 
 public:
   // Captures ownership of the _headerState.
@@ -186,11 +246,25 @@ public:
   ~LoopInProcess();
 
   void updateChangedObjects(const ExecutionState& current, TimingSolver* solver);
+  void loadCachedChangedBytes(KFunction *kf);
+  void applySummary(const StateByteMask &forgetMask);
+  void markNestedAnalysis() { nestedAnalysis = true; }
+  void markPathsInWorkers() { pathsInWorkers = true; }
+  /// Called in a worker process before it explores its paths.
+  void startWorker();
+  /// Write the bytes the paths of the worker changed, and its counters.
+  void writeWorkerReport(FILE *report);
+  /// Merge a report of writeWorkerReport into this round. Returns false,
+  /// leaving the analysis untouched, if the report is not complete.
+  bool mergeWorkerReport(FILE *report);
+  bool isUnaffectedPath(const ExecutionState &state) const;
+  void recordPath(const ExecutionState &state);
   ExecutionState* nextRoundState(bool *analysisFinished);
 
   const llvm::Loop *getLoop() const { return loop; }
   const StateByteMask &getChangedBytes() const { return changedBytes; }
   const ExecutionState &getEntryState() const { return *restartState; }
+  const LoopAnalysisProfile &getProfile() const { return profile; }
   const ref<LoopInProcess> &getOuter() const { return outer; }
 };
 
@@ -244,9 +318,20 @@ public:
   // TODO: replace with std::unique_ptr;
   ExecutionState *executionStateForLoopInProcess;
 
+  /// @brief The branches taken and the memory read since the start of
+  /// the current loop analysis round, used to skip the paths of the
+  /// round that can not be affected by the newly forgotten bytes.
+  std::vector<bool> loopPathBranches;
+  LoopPathReads loopPathReads;
+  bool loopPathSkipped;
+
   /// @brief Constraints collected so far
   ConstraintManager constraints;
 
+  /// @brief The constraints partitioned by the arrays they read, indexed
+  /// lazily by relevantConstraints()
+  mutable ConstraintSlices constraintSlices;
+
   /// Statistics and information
 
   /// @brief Costs for all queries issued for this state, in seconds
@@ -306,7 +391,15 @@ public:
   /// @brief Set of used array names for this state.  Used to avoid collisions.
   std::set<std::string> arrayNames;
 
-  std::vector<CallInfo> callPath;
+  /// @brief The traced calls. Forked states share the common prefix.
+  SharedPrefixList<CallInfo> callPath;
+
+  /// The number of calls at the start of callPath that no later execution
+  /// of this state can change: all but the last one, which may still be
+  /// traced further, and none past the calls of the states kept to restart
+  /// a loop analysis from.
+  size_t getFinalCallPathSize() const;
+
   SymbolSet relevantSymbols;
 
   /// @brief: a flag indicating that the state is genuine and not
@@ -367,6 +460,10 @@ public:
   void addSymbolic(const MemoryObject *mo, const Array *array);
   void addConstraint(ref<Expr> e) { constraints.addConstraint(e); }
 
+  void recordLoopRead(const MemoryObject *mo, ref<Expr> offset, unsigned bytes);
+  void recordLoopReadObject(const MemoryObject *mo);
+  void recordLoopReadAll();
+
   bool merge(const ExecutionState &b);
   void dumpStack() const;
   void dumpStack(llvm::raw_ostream &out) const;
@@ -461,8 +558,8 @@ public:
                                           bool *terminate);
   std::vector<ref<Expr> > relevantConstraints(SymbolSet symbols) const;
   void terminateState(ExecutionState **replace);
-  void induceInvariantsForThisLoop(KInstruction *target);
-  void startInvariantSearch();
+  void induceInvariantsForThisLoop(KInstruction *target, bool *terminate);
+  void startInvariantSearch(bool *terminate);
 };
 }
 
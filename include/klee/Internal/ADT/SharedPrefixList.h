@@ -0,0 +1,102 @@
+//===-- SharedPrefixList.h --------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef __UTIL_SHAREDPREFIXLIST_H__
+#define __UTIL_SHAREDPREFIXLIST_H__
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+namespace klee {
+  /// A list that only grows at the back, stored as reference counted
+  /// nodes linked from the last element to the first. Copies share all
+  /// the nodes, so copying is O(1), and two copies that append different
+  /// elements keep sharing their common prefix.
+  ///
+  /// Only the last element may be modified. If its node is shared, the
+  /// non-const back() first replaces it with a private copy, so the
+  /// modification is not visible to the other lists.
+  template<class T>
+  class SharedPrefixList {
+    struct Node {
+      unsigned refCount;
+      Node *prev;
+      size_t size;
+      T value;
+
+      Node(Node *_prev, const T &_value)
+        : refCount(1), prev(_prev), size(_prev ? _prev->size + 1 : 1),
+          value(_value) {
+        if (prev) ++prev->refCount;
+      }
+    };
+
+    Node *last;
+
+    static void release(Node *n) {
+      // Iterate rather than recurse, the lists may be long.
+      while (n && --n->refCount == 0) {
+        Node *prev = n->prev;
+        delete n;
+        n = prev;
+      }
+    }
+
+  public:
+    SharedPrefixList() : last(0) {}
+    SharedPrefixList(const SharedPrefixList &b) : last(b.last) {
+      if (last) ++last->refCount;
+    }
+    ~SharedPrefixList() { release(last); }
+
+    SharedPrefixList &operator=(const SharedPrefixList &b) {
+      if (b.last) ++b.last->refCount;
+      release(last);
+      last = b.last;
+      return *this;
+    }
+
+    bool empty() const { return !last; }
+    size_t size() const { return last ? last->size : 0; }
+
+    const T &back() const {
+      assert(last && "back() of an empty list");
+      return last->value;
+    }
+
+    T &back() {
+      assert(last && "back() of an empty list");
+      if (last->refCount > 1) {
+        Node *copy = new Node(last->prev, last->value);
+        --last->refCount;
+        last = copy;
+      }
+      return last->value;
+    }
+
+    void push_back(const T &value) {
+      Node *n = new Node(last, value);
+      // The new node took its own reference to the old last one.
+      release(last);
+      last = n;
+    }
+
+    /// The elements, from the first to the last one.
+    std::vector<const T *> elements() const {
+      std::vector<const T *> result(size());
+      size_t i = result.size();
+      for (const Node *n = last; n; n = n->prev)
+        result[--i] = &n->value;
+      return result;
+    }
+  };
+}
+
+#endif
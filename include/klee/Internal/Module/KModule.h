@@ -56,6 +56,10 @@ namespace klee {
     typedef llvm::LoopInfoBase<llvm::BasicBlock, llvm::Loop> LInfo;
     LInfo loopInfo;
 
+    /// The loops that contain a klee_induce_invariants call. Only
+    /// entering these loops requires keeping a copy of the entry state.
+    std::set<const llvm::Loop*> invariantInductionLoops;
+
     /// Whether instructions in this function should count as
     /// "coverable" for statistics and search heuristics.
     bool trackCoverage;
@@ -77,6 +81,10 @@ namespace klee {
 
     unsigned getArgRegister(unsigned index) { return index; }
 
+    bool mayInduceInvariants(const llvm::Loop *loop) const {
+      return invariantInductionLoops.count(loop);
+    }
+
     bool insert(const llvm::Loop *loop,
                 const StateByteMask& forgetMask,
                 const ExecutionState& state);
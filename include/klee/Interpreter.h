@@ -27,6 +27,7 @@ class raw_fd_ostream;
 }
 
 namespace klee {
+struct CallInfo;
 class ExecutionState;
 class Interpreter;
 class TreeStreamWriter;
@@ -47,6 +48,8 @@ public:
                                const char *err, 
                                const char *suffix) = 0;
   virtual void processCallPath(const ExecutionState &state) = 0;
+  /// Wait until the outputs of all the processed paths are written.
+  virtual void flushOutput() = 0;
 };
 
 struct HavocedLocation {
@@ -173,6 +176,12 @@ public:
 
   virtual void getCoveredLines(const ExecutionState &state,
                                std::map<const std::string*, std::set<unsigned> > &res) = 0;
+
+  /// Collect, for every state of the process tree other than \a except,
+  /// the calls of its call path that no later execution can change.
+  virtual void getLiveCallPathPrefixes(const ExecutionState *except,
+                                       std::vector<std::vector<const CallInfo *> >
+                                       &res) = 0;
 };
 
 } // End klee namespace
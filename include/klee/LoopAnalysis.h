@@ -11,31 +11,189 @@
 #define LOOP_ANALYSIS_H
 
 #include "klee/util/BitArray.h"
+#include "klee/util/ExprHashMap.h"
 // FIXME: We do not want to be exposing these? :(
 #include "../../lib/Core/AddressSpace.h"
 
+#include <map>
+#include <string>
+#include <stdint.h>
+#include <vector>
+
+namespace llvm {
+class Loop;
+class raw_ostream;
+}
+
 namespace klee {
 class MemoryObject;
 class ExecutionState;
 class TimingSolver;
+struct KFunction;
 
 /// A global bytemask for all the memory of a program.
 typedef std::map<const MemoryObject *, BitArray *> StateByteMask;
 
+/// The summary of an analysed loop: the induced forget mask and the
+/// loop entry state it was induced for.
 struct LoopEntryState {
-  StateByteMask forgetMask;
+  StateByteMask forgetMask; //Owner for the bitarrays.
   const AddressSpace addressSpace;
+  /// The path constraints and the registers of the loop function at the
+  /// loop entry.
+  const std::vector<ref<Expr> > constraints;
+  const std::vector<ref<Expr> > locals;
 
  LoopEntryState(const StateByteMask &_fmask,
-                const AddressSpace &_aspace)
- :forgetMask(_fmask), addressSpace(_aspace)
-  {}
+                const AddressSpace &_aspace,
+                const std::vector<ref<Expr> > &_constraints,
+                const std::vector<ref<Expr> > &_locals)
+ :addressSpace(_aspace), constraints(_constraints), locals(_locals)
+  {
+    for (StateByteMask::const_iterator i = _fmask.begin(), e = _fmask.end();
+         i != e; ++i)
+      forgetMask[i->first] = new BitArray(*i->second, i->second->size());
+  }
+  ~LoopEntryState() {
+    for (StateByteMask::iterator i = forgetMask.begin(), e = forgetMask.end();
+         i != e; ++i)
+      delete i->second;
+  }
+
+  /// Whether the forget mask is also an invariant of the \a loop entered
+  /// in the \a entryState. That is the case if the \a entryState has at
+  /// least the constraints of the summarised one, and the same values in
+  /// the memory outside of the mask and in the registers the loop does
+  /// not define.
+  bool appliesTo(const ExecutionState &entryState,
+                 const llvm::Loop *loop, KFunction *kf) const;
+
+private:
+  LoopEntryState(const LoopEntryState &);
+  LoopEntryState &operator=(const LoopEntryState &);
  };
 
+/// The memory bytes read by a path through the loop body during one
+/// round of the invariant analysis.
+struct LoopPathReads {
+  /// The path read memory in a way that is not tracked per byte,
+  /// e.g. through an external call.
+  bool all;
+  std::map<const MemoryObject *, std::vector<bool> > bytes;
+
+  LoopPathReads() : all(false) {}
+
+  void record(const MemoryObject *mo, unsigned offset, unsigned size);
+  void recordObject(const MemoryObject *mo);
+  bool intersects(const StateByteMask &mask) const;
+};
+
+/// The byte pairs compared by updateDiffMask during one loop analysis,
+/// keyed by the EqExpr of the pair. True if the pair is equal after the
+/// normalization of the reads, which does not depend on the path.
+typedef ExprHashMap<bool> ByteDiffCache;
+
+/// A byte whose diff query timed out. It is checked again at the end of
+/// the round, in the constraints of the path that compared it.
+struct DeferredByteDiff {
+  const MemoryObject *obj;
+  unsigned offset;
+  ref<Expr> refVal;
+  ref<Expr> val;
+  std::vector<ref<Expr> > constraints;
+  ObjectHolder refOs;
+  ObjectHolder os;
+  bool undeclaredHavoc;
+  std::string neverHavoc;
+};
+
+/// What updateDiffMask keeps across the rounds of one loop analysis.
+struct DiffMaskContext {
+  ByteDiffCache cache;
+  /// The recent diff query latencies in seconds, for the adaptive timeout.
+  std::vector<double> latencies;
+  unsigned nextLatency;
+  std::vector<DeferredByteDiff> deferred;
+  /// The solver to retry the deferred bytes with.
+  TimingSolver *solver;
+
+  DiffMaskContext() : nextLatency(0), solver(0) {}
+};
+
+/// Extend the \a mask with the bytes that may differ between
+/// \a refValues and the memory of \a state. Returns true if the mask
+/// was extended. With a \a ctx, the structural comparisons are cached and
+/// the bytes whose query timed out are deferred to retryDeferredDiffs.
 bool updateDiffMask(StateByteMask* mask,
                       const AddressSpace& refValues,
                       const ExecutionState& state,
-                      TimingSolver* solver);
+                      TimingSolver* solver,
+                      DiffMaskContext *ctx = 0);
+
+/// Check the bytes deferred in the \a ctx again with the larger
+/// --loop-analysis-retry-timeout, and extend the \a mask with the ones
+/// that may differ or time out again. Returns true if the mask was
+/// extended.
+bool retryDeferredDiffs(StateByteMask *mask, DiffMaskContext *ctx);
+
+/// Seed the \a mask with the invariant induced for the \a loop by a previous
+/// klee run, if --loop-invariant-cache is given and has a matching entry.
+/// The memory objects are found by their havoc names in the \a headerState;
+/// a name shared by several klee_possibly_havoc calls does not match.
+/// Returns true on a cache hit.
+bool lookupCachedInvariant(const llvm::Loop *loop, KFunction *kf,
+                           const ExecutionState &headerState,
+                           StateByteMask *mask);
+
+/// Record the converged \a mask for the \a loop in the --loop-invariant-cache
+/// file, so that later klee runs can start from it. Nothing is recorded if
+/// the mask covers a location without a havoc name or with a shared one.
+void storeCachedInvariant(const llvm::Loop *loop, KFunction *kf,
+                          const ExecutionState &headerState,
+                          const StateByteMask &mask);
+
+/// The counters of one loop invariant analysis, for --loop-analysis-stats.
+struct LoopAnalysisProfile {
+  struct Round {
+    /// The paths that finished in this round.
+    unsigned paths;
+    /// The bytes added to the forget mask by this round.
+    unsigned bytesAdded;
+    /// The solver queries of updateDiffMask, and the time spent there
+    /// in microseconds.
+    uint64_t queries;
+    uint64_t diffTime;
+    /// The per-byte queries that the range queries made unnecessary.
+    uint64_t queriesSaved;
+    /// The paths of this round cut short because they could not read the
+    /// bytes forgotten by the previous round.
+    unsigned pathsSkipped;
+    /// The paths of this round explored by --loop-analysis-workers.
+    unsigned workerPaths;
+
+    Round()
+      : paths(0), bytesAdded(0), queries(0), diffTime(0), queriesSaved(0),
+        pathsSkipped(0), workerPaths(0) {}
+  };
+  std::vector<Round> rounds;
+  /// The size of the forget mask at the end of the last round.
+  unsigned maskBytes;
+  /// Whether the mask was seeded from the --loop-invariant-cache.
+  bool cacheHit;
+  double startTime;
+
+  LoopAnalysisProfile();
+};
+
+bool loopAnalysisStatsEnabled();
+
+/// Keep the \a profile of the finished analysis of the \a loop for the
+/// loop-analysis.stats report.
+void recordLoopAnalysis(const llvm::Loop *loop, KFunction *kf,
+                        const LoopAnalysisProfile &profile);
+
+/// Write the profiles of all the finished loop analyses.
+void writeLoopAnalysisStats(llvm::raw_ostream &os);
 
 //#define DO_LOG_LOOP_ANALYSIS
 #ifdef DO_LOG_LOOP_ANALYSIS
@@ -0,0 +1,66 @@
+//===-- ConstraintSlices.h --------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_CONSTRAINTSLICES_H
+#define KLEE_CONSTRAINTSLICES_H
+
+#include "klee/Constraints.h"
+#include "klee/util/GetExprSymbols.h"
+
+#include <map>
+#include <vector>
+
+namespace klee {
+
+/// Partitions the constraints of a ConstraintManager by the arrays they
+/// read: two constraints are in the same slice if they are connected by a
+/// chain of constraints sharing arrays. The arrays are kept in a union-find,
+/// and the slices are updated as constraints are added, so that a slice can
+/// be fetched in time proportional to its size.
+class ConstraintSlices {
+  std::map<const Array *, unsigned> arrayIds;
+  std::vector<unsigned> parent;
+  /// The constraints of each set, by their position, valid for the roots.
+  std::vector<std::vector<unsigned> > members;
+
+  /// The part of the constraints that was indexed. A constraint manager
+  /// that was rewritten, or no longer extends that part, is indexed again.
+  /// The last indexed constraint is held, so that its address is not reused.
+  size_t indexedSize;
+  ref<Expr> lastIndexed;
+  unsigned rewrites;
+
+  unsigned find(unsigned id);
+  unsigned arrayId(const Array *array);
+  unsigned unite(unsigned a, unsigned b);
+  void clear();
+
+public:
+  ConstraintSlices() : indexedSize(0), rewrites(0) {}
+
+  /// Index the constraints added to \a constraints since the last update.
+  void update(const ConstraintManager &constraints);
+
+  /// The constraints of \a constraints that are connected to \a symbols,
+  /// in their order in \a constraints. Updates the index first.
+  std::vector<ref<Expr> > getSlice(const ConstraintManager &constraints,
+                                   const SymbolSet &symbols);
+
+  /// The constraints of \a constraints, then the ones of \a extra, that
+  /// are connected to \a symbols, also through the \a extra constraints.
+  /// These are not indexed, so that a few constraints added on top of the
+  /// same \a constraints do not invalidate the index.
+  std::vector<ref<Expr> > getSlice(const ConstraintManager &constraints,
+                                   const SymbolSet &symbols,
+                                   const std::vector<ref<Expr> > &extra);
+};
+
+}
+
+#endif
@@ -10,26 +10,52 @@
 #ifndef KLEE_GETEXPRSYMBOLS_H
 #define KLEE_GETEXPRSYMBOLS_H
 
+#include "klee/Expr.h"
+
+#include <llvm/ADT/DenseMap.h>
 #include <llvm/ADT/SmallPtrSet.h>
-#include "ExprAnalysis.h"
+
+#include <map>
+#include <vector>
 
 namespace klee {
 
 typedef llvm::SmallPtrSet<const Array*, 100> SymbolSet;
 
-class GetExprSymbols: public ExprAnalysis<GetExprSymbols, SymbolSet > {
+/// Memoizes the arrays read by expressions, including the arrays read by
+/// the indices and values of their update lists. Every expression and
+/// update node shared in the DAG is visited once, and equal array sets are
+/// stored once. The memoized expressions and update nodes are kept alive,
+/// the cache is cleared before a lookup once it holds more than \a capacity
+/// of them.
+class ExprSymbolCache {
+  typedef std::vector<const Array *> Arrays; // sorted
+
+  unsigned capacity;
+  std::map<Arrays, unsigned> setIds;
+  std::vector<const Arrays *> sets;
+  llvm::DenseMap<const Expr *, unsigned> exprSets;
+  llvm::DenseMap<const UpdateNode *, unsigned> updateSets;
+  std::vector<ref<Expr> > heldExprs;
+  std::vector<UpdateList> heldUpdates;
+
+  unsigned getSetId(const Arrays &arrays);
+  unsigned unite(unsigned a, unsigned b);
+  unsigned visitExpr(const ref<Expr> &e);
+  unsigned visitUpdates(const UpdateList &updates);
+
+public:
+  explicit ExprSymbolCache(unsigned capacity);
+
+  SymbolSet getSymbols(const ref<Expr> &e);
+  void clear();
 };
 
-
-template<>
-SymbolSet ExprAnalysis<GetExprSymbols,
-                       SymbolSet >::
-visitChildren(const Expr& expr);
-
-template<>
-SymbolSet ExprAnalysis<GetExprSymbols,
-                       SymbolSet >::
-visitRead(const ReadExpr&);
+class GetExprSymbols {
+public:
+  /// The arrays read by \a e, memoized in a cache shared by all the users.
+  static SymbolSet visit(const ref<Expr> &e);
+};
 
 }
 
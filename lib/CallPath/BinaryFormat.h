@@ -0,0 +1,55 @@
+//===-- BinaryFormat.h ------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// The layout of the binary call path files. All the integers are unsigned
+// LEB128 varints, and the strings are a length followed by the bytes.
+//
+//   magic, version
+//   arrays:      count, then name, size, domain, range and the constant
+//                values (a count, then one integer each) of every array
+//   nodes:       count, then the records of the expressions and the update
+//                nodes, each after the nodes it refers to
+//   calls:       count, then the function name and the arguments and extra
+//                variables (a count, then name, before and after each)
+//   constraints: count, then one expression each
+//
+// An expression record is the ExprRecord tag, the Expr::Kind and the
+// operands of the kind. An update node record is the UpdateRecord tag and
+// the next update node, the index and the value. The expressions, update
+// nodes and arrays are referred to by their index in the order they were
+// written. The optional references (the update list of a read, the next
+// update node, the values of the calls) are the index plus one, or 0.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_CALLPATH_BINARYFORMAT_H
+#define KLEE_CALLPATH_BINARYFORMAT_H
+
+#include <stdint.h>
+
+namespace klee {
+namespace callpath {
+
+static const char BinaryMagic[4] = { '\x7f', 'K', 'C', 'P' };
+static const unsigned BinaryVersion = 1;
+
+/// The widest expression, and the longest string, the reader accepts. A
+/// corrupt width or length is rejected before anything is allocated for it.
+static const uint64_t MaxExprWidth = 1 << 16;
+static const uint64_t MaxStringSize = 1 << 20;
+
+enum RecordTag {
+  ExprRecord = 0,
+  UpdateRecord = 1
+};
+
+}
+}
+
+#endif
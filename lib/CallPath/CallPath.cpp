@@ -0,0 +1,780 @@
+//===-- CallPath.cpp ------------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "BinaryFormat.h"
+
+#include "klee/CallPath.h"
+#include "klee/Config/Version.h"
+#include "klee/ExprBuilder.h"
+#include "klee/util/ArrayCache.h"
+#include "expr/Parser.h"
+
+#include "llvm/ADT/APInt.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+using namespace klee;
+using namespace klee::callpath;
+
+CallPath::CallPath() : parser(0), buffer(0), arrayCache(0) {}
+
+CallPath::~CallPath() {
+  // Release the expressions before the arrays they read.
+  constraints.clear();
+  calls.clear();
+  initial_extra_vars.clear();
+  delete parser;
+  delete buffer;
+  delete arrayCache;
+}
+
+namespace klee {
+class CallPathLoader {
+  const std::set<std::string> &symbols;
+  const std::vector<std::string> &exprStrs;
+  std::deque<ref<Expr> > &exprs;
+  std::string &error;
+
+  bool parseKQuery(CallPath *callPath, const std::string &kQuery,
+                   std::vector<ref<Expr> > &constraints,
+                   std::vector<ref<Expr> > &values);
+  void assignCallExprs(CallPath *callPath, const std::string &extraVar,
+                       std::vector<std::string> &exprGroups);
+
+  /// The values of the kQuery of a text call path that belong to the
+  /// calls. They are taken in order, except for the (@index) references of
+  /// the shared text format.
+  std::vector<ref<Expr> > callValues;
+  size_t nextCallValue;
+  bool sharedValues;
+  ref<Expr> takeCallValue(const std::string &str);
+
+public:
+  CallPathLoader(const std::set<std::string> &_symbols,
+                 const std::vector<std::string> &_exprStrs,
+                 std::deque<ref<Expr> > &_exprs, std::string &_error)
+    : symbols(_symbols), exprStrs(_exprStrs), exprs(_exprs), error(_error),
+      nextCallValue(0), sharedValues(false) {}
+
+  CallPath *loadText(std::istream &is);
+  CallPath *loadBinary(std::istream &is);
+};
+}
+
+namespace {
+std::string arrayDeclName(const std::string &decl) {
+  std::string name = decl.substr(sizeof("array ") - 1);
+  return name.substr(0, name.find("["));
+}
+
+void noteExtraVar(CallPath *callPath, const std::string &name,
+                  const ref<Expr> &before) {
+  if (!before.isNull() && !callPath->initial_extra_vars.count(name))
+    callPath->initial_extra_vars[name] = before;
+}
+
+/// Collect the top level parenthesized groups of the \a line into
+/// \a groups. Returns the nesting level at the end of the line.
+int collectExprGroups(const std::string &line, int level,
+                      std::string &current,
+                      std::vector<std::string> &groups) {
+  for (std::string::const_iterator it = line.begin(), ie = line.end();
+       it != ie; ++it) {
+    char c = *it;
+    current += c;
+    if (c == '(') {
+      if (level == 0)
+        current = "(";
+      level++;
+    } else if (c == ')') {
+      level--;
+      assert(level >= 0);
+      if (level == 0)
+        groups.push_back(current);
+    }
+  }
+  return level;
+}
+
+bool readVarint(std::istream &is, uint64_t &value) {
+  value = 0;
+  for (unsigned shift = 0; shift < 64; shift += 7) {
+    int byte = is.get();
+    if (byte == EOF)
+      return false;
+    value |= (uint64_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+      return true;
+  }
+  return false;
+}
+
+bool readString(std::istream &is, std::string &s) {
+  uint64_t size;
+  if (!readVarint(is, size) || size > MaxStringSize)
+    return false;
+  s.resize(size);
+  return size == 0 || is.read(&s[0], size);
+}
+
+/// Reads the index of an entry of a table of \a tableSize entries.
+bool readIndex(std::istream &is, size_t tableSize, uint64_t &index) {
+  return readVarint(is, index) && index < tableSize;
+}
+
+/// Reads an optional reference to a table entry: its index plus one, or 0.
+bool readRef(std::istream &is, size_t tableSize, uint64_t &ref) {
+  return readVarint(is, ref) && ref <= tableSize;
+}
+
+bool validWidth(uint64_t width) {
+  return width > 0 && width <= MaxExprWidth;
+}
+
+/// Whether the operands of an expression of \a kind have widths that the
+/// Expr classes accept, so that a corrupt file is rejected here rather
+/// than by an assertion of the solver.
+bool validOperands(uint64_t kind, const std::vector<ref<Expr> > &kids,
+                   const std::vector<uint64_t> &ops) {
+  switch (kind) {
+  case Expr::NotOptimized:
+  case Expr::Not:
+    return true;
+  case Expr::Extract:
+    return validWidth(ops[1]) && ops[0] < kids[0]->getWidth() &&
+           ops[1] <= kids[0]->getWidth() - ops[0];
+  case Expr::ZExt:
+  case Expr::SExt:
+    return validWidth(ops[0]) && ops[0] >= kids[0]->getWidth();
+  case Expr::Select:
+    return kids[0]->getWidth() == Expr::Bool &&
+           kids[1]->getWidth() == kids[2]->getWidth();
+  case Expr::Concat:
+    return validWidth((uint64_t)kids[0]->getWidth() + kids[1]->getWidth());
+  default:
+    return kids[0]->getWidth() == kids[1]->getWidth();
+  }
+}
+
+/// The update records of a binary call path. An update record does not
+/// name its array, so its widths are only checked by the reads using it.
+struct UpdateTable {
+  std::vector<UpdateList> lists;
+  /// The record each record continues, plus one, or 0.
+  std::vector<uint64_t> next;
+  /// The index and value widths each record was checked against, or 0.
+  std::vector<std::pair<Expr::Width, Expr::Width> > checked;
+
+  /// Whether the updates from the record \a ref on, given as its index
+  /// plus one, have the index and value widths of \a array.
+  bool validFor(uint64_t ref, const Array *array) {
+    std::pair<Expr::Width, Expr::Width> widths(array->getDomain(),
+                                               array->getRange());
+    for (; ref; ref = next[ref - 1]) {
+      if (checked[ref - 1] == widths)
+        return true;
+      const UpdateNode *un = lists[ref - 1].head;
+      if (un->index->getWidth() != widths.first ||
+          un->value->getWidth() != widths.second)
+        return false;
+      checked[ref - 1] = widths;
+    }
+    return true;
+  }
+};
+
+struct ArrayEntry {
+  std::string name;
+  uint64_t size, domain, range;
+  std::vector<uint64_t> values;
+};
+}
+
+bool CallPathLoader::parseKQuery(CallPath *callPath, const std::string &kQuery,
+                                 std::vector<ref<Expr> > &constraints,
+                                 std::vector<ref<Expr> > &values) {
+  // The parser owns the arrays it declares, so it lives as long as the
+  // call path.
+#if LLVM_VERSION_CODE >= LLVM_VERSION(3, 6)
+  callPath->buffer = llvm::MemoryBuffer::getMemBufferCopy(kQuery).release();
+#else
+  callPath->buffer = llvm::MemoryBuffer::getMemBufferCopy(kQuery);
+#endif
+  ExprBuilder *builder = createDefaultExprBuilder();
+  callPath->parser =
+      expr::Parser::Create("", callPath->buffer, builder, false);
+  // The parser refers to the array declarations until the end.
+  std::vector<expr::Decl *> decls;
+  while (expr::Decl *D = callPath->parser->ParseTopLevelDecl()) {
+    if (expr::ArrayDecl *AD = dyn_cast<expr::ArrayDecl>(D)) {
+      callPath->arrays[AD->Root->name] = AD->Root;
+    } else if (expr::QueryCommand *QC = dyn_cast<expr::QueryCommand>(D)) {
+      constraints = QC->Constraints;
+      values = QC->Values;
+    }
+    decls.push_back(D);
+  }
+  for (std::vector<expr::Decl *>::iterator it = decls.begin(),
+         ie = decls.end(); it != ie; ++it)
+    delete *it;
+  delete builder;
+
+  if (callPath->parser->GetNumErrors()) {
+    error = "error parsing the kQuery of the call path";
+    return false;
+  }
+  return true;
+}
+
+ref<Expr> CallPathLoader::takeCallValue(const std::string &str) {
+  if (str.compare(0, 2, "(@") == 0) {
+    size_t index = strtoul(str.c_str() + 2, 0, 10);
+    assert(index < callValues.size() && "Invalid expression reference.");
+    return callValues[index];
+  }
+  assert(nextCallValue < callValues.size() &&
+         "Not enough expression in kQuery.");
+  return callValues[nextCallValue++];
+}
+
+void CallPathLoader::assignCallExprs(CallPath *callPath,
+                                     const std::string &extraVar,
+                                     std::vector<std::string> &exprGroups) {
+  CallPathCall &call = callPath->calls.back();
+
+  if (!extraVar.empty()) {
+    assert(exprGroups.size() == 2 && "Too many expression in extra variable.");
+    for (unsigned i = 0; i < 2; ++i) {
+      if (exprGroups[i] == "(...)")
+        continue;
+      (i ? call.extra_vars[extraVar].second : call.extra_vars[extraVar].first) =
+          takeCallValue(exprGroups[i]);
+    }
+    noteExtraVar(callPath, extraVar, call.extra_vars[extraVar].first);
+    return;
+  }
+
+  bool parsed_last_arg = false;
+  while (!parsed_last_arg) {
+    if (exprGroups[0] == "()")
+      break;
+    size_t delim = exprGroups[0].find(",");
+    if (delim == std::string::npos) {
+      delim = exprGroups[0].size() - 1;
+      parsed_last_arg = true;
+    }
+    std::string current_arg = exprGroups[0].substr(0, delim);
+    if (current_arg[0] == '(')
+      current_arg = current_arg.substr(1);
+    exprGroups[0] = exprGroups[0].substr(delim + 1);
+    delim = current_arg.find(":");
+    assert(delim != std::string::npos);
+    std::string current_arg_name = current_arg.substr(0, delim);
+    current_arg = current_arg.substr(delim + 1);
+
+    delim = current_arg.find("&");
+    if (delim == std::string::npos) {
+      call.args[current_arg_name].first = takeCallValue(current_arg);
+      continue;
+    }
+
+    if (current_arg.substr(delim + 1) == "[...]" ||
+        current_arg.substr(delim + 1)[0] != '[')
+      continue;
+
+    current_arg = current_arg.substr(delim + 2);
+    delim = current_arg.find("]");
+    assert(delim != std::string::npos);
+    current_arg = current_arg.substr(0, delim);
+
+    delim = current_arg.find("->");
+    assert(delim != std::string::npos);
+
+    if (current_arg.substr(0, delim).size()) {
+      call.args[current_arg_name].first =
+          takeCallValue(current_arg.substr(0, delim));
+    }
+    if (current_arg.substr(delim + 2).size()) {
+      call.args[current_arg_name].second =
+          takeCallValue(current_arg.substr(delim + 2));
+    }
+  }
+}
+
+CallPath *CallPathLoader::loadText(std::istream &is) {
+  CallPath *callPath = new CallPath;
+
+  enum {
+    STATE_INIT,
+    STATE_KQUERY,
+    STATE_CALLS,
+    STATE_CALLS_MULTILINE,
+    STATE_DONE
+  } state = STATE_INIT;
+
+  std::string kQuery;
+  std::set<std::string> declared_arrays;
+
+  int parenthesis_level = 0;
+  std::string current_extra_var;
+  std::string current_expr_str;
+  std::vector<std::string> current_exprs_str;
+
+  while (!is.eof() && state != STATE_DONE) {
+    std::string line;
+    std::getline(is, line);
+
+    switch (state) {
+    case STATE_INIT: {
+      if (line == ";;-- kQuery --") {
+        state = STATE_KQUERY;
+      }
+    } break;
+
+    case STATE_KQUERY: {
+      if (line != ";;-- Calls --") {
+        kQuery += "\n" + line;
+        if (line.substr(0, sizeof("array ") - 1) == "array ")
+          declared_arrays.insert(arrayDeclName(line));
+        break;
+      }
+
+      for (std::set<std::string>::const_iterator it = symbols.begin(),
+             ie = symbols.end(); it != ie; ++it) {
+        if (!declared_arrays.count(arrayDeclName(*it)))
+          kQuery = *it + "\n" + kQuery;
+      }
+
+      // Parse the requested expressions as extra values of the query, so
+      // that they refer to the same arrays as the call path.
+      if (!exprStrs.empty()) {
+        if (kQuery.substr(kQuery.length() - 2) == "])") {
+          kQuery = kQuery.substr(0, kQuery.length() - 2) + "\n";
+        } else {
+          assert(kQuery.substr(kQuery.length() - 6) == "false)");
+          kQuery = kQuery.substr(0, kQuery.length() - 1) + " [\n";
+        }
+        for (std::vector<std::string>::const_iterator it = exprStrs.begin(),
+               ie = exprStrs.end(); it != ie; ++it)
+          kQuery += "\n         " + *it;
+        kQuery += "])";
+      }
+
+      std::vector<ref<Expr> > constraints;
+      if (!parseKQuery(callPath, kQuery, constraints, callValues)) {
+        delete callPath;
+        return 0;
+      }
+      callPath->constraints = ConstraintManager(constraints);
+
+      // The requested expressions are the last values.
+      assert(callValues.size() >= exprStrs.size() &&
+             "Too few expressions in kQuery.");
+      exprs.insert(exprs.end(), callValues.end() - exprStrs.size(),
+                   callValues.end());
+      callValues.resize(callValues.size() - exprStrs.size());
+
+      state = STATE_CALLS;
+    } break;
+
+    case STATE_CALLS: {
+      // The shared values may also be referred to by the return values
+      // only, which are not read back.
+      if (line.find("(@") != std::string::npos)
+        sharedValues = true;
+
+      if (line == ";;-- Constraints --") {
+        assert((sharedValues || nextCallValue == callValues.size()) &&
+               "Too many expressions in kQuery.");
+
+        state = STATE_DONE;
+        break;
+      }
+
+      size_t delim = line.find(":");
+      assert(delim != std::string::npos);
+      std::string preamble = line.substr(0, delim);
+      line = line.substr(delim + 1);
+
+      current_extra_var.clear();
+      current_exprs_str.clear();
+
+      if (preamble == "extra") {
+        while (line[0] == ' ') {
+          line = line.substr(1);
+        }
+
+        delim = line.find("&");
+        assert(delim != std::string::npos);
+        current_extra_var = line.substr(0, delim);
+        line = line.substr(delim + 1);
+
+        delim = line.find("[");
+        assert(delim != std::string::npos);
+        line = line.substr(delim + 1);
+      } else {
+        callPath->calls.push_back(CallPathCall());
+
+        delim = line.find("(");
+        assert(delim != std::string::npos);
+        callPath->calls.back().function_name = line.substr(0, delim);
+      }
+
+      parenthesis_level = collectExprGroups(line, parenthesis_level,
+                                            current_expr_str,
+                                            current_exprs_str);
+      if (parenthesis_level > 0) {
+        state = STATE_CALLS_MULTILINE;
+      } else {
+        assignCallExprs(callPath, current_extra_var, current_exprs_str);
+      }
+    } break;
+
+    case STATE_CALLS_MULTILINE: {
+      current_expr_str += " ";
+      parenthesis_level = collectExprGroups(line, parenthesis_level,
+                                            current_expr_str,
+                                            current_exprs_str);
+      if (parenthesis_level == 0) {
+        assignCallExprs(callPath, current_extra_var, current_exprs_str);
+        state = STATE_CALLS;
+      }
+    } break;
+
+    default: {
+      assert(false && "Invalid call path file.");
+    } break;
+    }
+  }
+
+  return callPath;
+}
+
+CallPath *CallPathLoader::loadBinary(std::istream &is) {
+  CallPath *callPath = new CallPath;
+  error = "malformed binary call path";
+
+  uint64_t version;
+  if (!readVarint(is, version) || version != BinaryVersion) {
+    error = "unsupported binary call path version";
+    delete callPath;
+    return 0;
+  }
+
+  uint64_t count;
+  std::vector<ArrayEntry> arrayEntries;
+  bool ok = readVarint(is, count);
+  for (uint64_t i = 0; ok && i < count; ++i) {
+    ArrayEntry entry;
+    uint64_t numValues;
+    ok = readString(is, entry.name) && readVarint(is, entry.size) &&
+         readVarint(is, entry.domain) && readVarint(is, entry.range) &&
+         readVarint(is, numValues) && validWidth(entry.domain) &&
+         validWidth(entry.range);
+    for (uint64_t j = 0; ok && j < numValues; ++j) {
+      entry.values.push_back(0);
+      ok = readVarint(is, entry.values.back());
+    }
+    arrayEntries.push_back(entry);
+  }
+  if (!ok) {
+    delete callPath;
+    return 0;
+  }
+
+  std::vector<const Array *> arrayTable;
+  if (symbols.empty() && exprStrs.empty()) {
+    callPath->arrayCache = new ArrayCache();
+    for (std::vector<ArrayEntry>::iterator it = arrayEntries.begin(),
+           ie = arrayEntries.end(); it != ie; ++it) {
+      std::vector<ref<ConstantExpr> > values;
+      for (unsigned i = 0; i < it->values.size(); ++i)
+        values.push_back(ConstantExpr::alloc(it->values[i], it->range));
+      const Array *array = callPath->arrayCache->CreateArray(
+          it->name, it->size, values.empty() ? 0 : &values[0],
+          values.empty() ? 0 : &values[0] + values.size(), it->domain,
+          it->range);
+      callPath->arrays[it->name] = array;
+      arrayTable.push_back(array);
+    }
+  } else {
+    // The requested expressions must read the same arrays as the call
+    // path, so the arrays are declared to the kQuery parser along with
+    // them, and taken from there.
+    std::ostringstream kQuery;
+    std::set<std::string> declared_arrays;
+    for (std::vector<ArrayEntry>::iterator it = arrayEntries.begin(),
+           ie = arrayEntries.end(); it != ie; ++it) {
+      kQuery << "array " << it->name << "[" << it->size << "] : w"
+             << it->domain << " -> w" << it->range << " = ";
+      if (it->values.empty()) {
+        kQuery << "symbolic\n";
+      } else {
+        kQuery << "[";
+        for (unsigned i = 0; i < it->values.size(); ++i)
+          kQuery << (i ? " " : "") << it->values[i];
+        kQuery << "]\n";
+      }
+      declared_arrays.insert(it->name);
+    }
+    for (std::set<std::string>::const_iterator it = symbols.begin(),
+           ie = symbols.end(); it != ie; ++it) {
+      if (!declared_arrays.count(arrayDeclName(*it)))
+        kQuery << *it << "\n";
+    }
+    kQuery << "(query [] false [";
+    for (std::vector<std::string>::const_iterator it = exprStrs.begin(),
+           ie = exprStrs.end(); it != ie; ++it)
+      kQuery << "\n         " << *it;
+    kQuery << "])\n";
+
+    std::vector<ref<Expr> > constraints, values;
+    if (!parseKQuery(callPath, kQuery.str(), constraints, values)) {
+      delete callPath;
+      return 0;
+    }
+    assert(values.size() == exprStrs.size());
+    exprs.insert(exprs.end(), values.begin(), values.end());
+    for (std::vector<ArrayEntry>::iterator it = arrayEntries.begin(),
+           ie = arrayEntries.end(); it != ie; ++it)
+      arrayTable.push_back(callPath->arrays[it->name]);
+  }
+
+  std::vector<ref<Expr> > exprTable;
+  UpdateTable updateTable;
+  ok = readVarint(is, count);
+  for (uint64_t i = 0; ok && i < count; ++i) {
+    uint64_t tag;
+    ok = readVarint(is, tag);
+    if (!ok)
+      break;
+
+    if (tag == UpdateRecord) {
+      uint64_t next, index, value;
+      ok = readRef(is, updateTable.lists.size(), next) &&
+           readIndex(is, exprTable.size(), index) &&
+           readIndex(is, exprTable.size(), value);
+      if (ok) {
+        updateTable.lists.push_back(UpdateList(
+            0, new UpdateNode(next ? updateTable.lists[next - 1].head : 0,
+                              exprTable[index], exprTable[value])));
+        updateTable.next.push_back(next);
+        updateTable.checked.push_back(std::make_pair(0, 0));
+      }
+      continue;
+    }
+    if (tag != ExprRecord) {
+      ok = false;
+      break;
+    }
+
+    uint64_t kind;
+    ok = readVarint(is, kind);
+    if (!ok)
+      break;
+
+    // The ids of the operand expressions, or the immediate operands.
+    std::vector<uint64_t> ops;
+    unsigned numExprOps = 0, numImmOps = 0;
+    switch (kind) {
+    case Expr::Constant: {
+      uint64_t width;
+      ok = readVarint(is, width) && validWidth(width);
+      if (!ok)
+        break;
+      std::vector<uint64_t> words((width + 63) / 64);
+      for (unsigned w = 0; ok && w < words.size(); ++w)
+        ok = readVarint(is, words[w]);
+      if (ok)
+        exprTable.push_back(ConstantExpr::alloc(
+            llvm::APInt((unsigned)width, words.size(), &words[0])));
+      continue;
+    }
+    case Expr::Read: {
+      uint64_t array, updates, index;
+      ok = readIndex(is, arrayTable.size(), array) &&
+           readRef(is, updateTable.lists.size(), updates) &&
+           readIndex(is, exprTable.size(), index) &&
+           exprTable[index]->getWidth() == arrayTable[array]->getDomain() &&
+           updateTable.validFor(updates, arrayTable[array]);
+      if (ok)
+        exprTable.push_back(ReadExpr::alloc(
+            UpdateList(arrayTable[array],
+                       updates ? updateTable.lists[updates - 1].head : 0),
+            exprTable[index]));
+      continue;
+    }
+    case Expr::NotOptimized:
+    case Expr::Not:
+      numExprOps = 1;
+      break;
+    case Expr::Extract:
+      numExprOps = 1;
+      numImmOps = 2;
+      break;
+    case Expr::ZExt:
+    case Expr::SExt:
+      numExprOps = 1;
+      numImmOps = 1;
+      break;
+    case Expr::Select:
+      numExprOps = 3;
+      break;
+    case Expr::Concat:
+      numExprOps = 2;
+      break;
+    default:
+      ok = kind >= Expr::BinaryKindFirst && kind <= Expr::BinaryKindLast;
+      numExprOps = 2;
+      break;
+    }
+
+    std::vector<ref<Expr> > kids;
+    for (unsigned k = 0; ok && k < numExprOps; ++k) {
+      uint64_t id;
+      ok = readIndex(is, exprTable.size(), id);
+      if (ok)
+        kids.push_back(exprTable[id]);
+    }
+    for (unsigned k = 0; ok && k < numImmOps; ++k) {
+      ops.push_back(0);
+      ok = readVarint(is, ops.back());
+    }
+    ok = ok && validOperands(kind, kids, ops);
+    if (!ok)
+      break;
+
+    ref<Expr> e;
+    switch (kind) {
+    case Expr::NotOptimized: e = NotOptimizedExpr::alloc(kids[0]); break;
+    case Expr::Not: e = NotExpr::alloc(kids[0]); break;
+    case Expr::Extract: e = ExtractExpr::alloc(kids[0], ops[0], ops[1]); break;
+    case Expr::ZExt: e = ZExtExpr::alloc(kids[0], ops[0]); break;
+    case Expr::SExt: e = SExtExpr::alloc(kids[0], ops[0]); break;
+    case Expr::Select: e = SelectExpr::alloc(kids[0], kids[1], kids[2]); break;
+    case Expr::Concat: e = ConcatExpr::alloc(kids[0], kids[1]); break;
+#define BINARY_EXPR_CASE(_kind)                                              \
+    case Expr::_kind: e = _kind##Expr::alloc(kids[0], kids[1]); break;
+    BINARY_EXPR_CASE(Add)
+    BINARY_EXPR_CASE(Sub)
+    BINARY_EXPR_CASE(Mul)
+    BINARY_EXPR_CASE(UDiv)
+    BINARY_EXPR_CASE(SDiv)
+    BINARY_EXPR_CASE(URem)
+    BINARY_EXPR_CASE(SRem)
+    BINARY_EXPR_CASE(And)
+    BINARY_EXPR_CASE(Or)
+    BINARY_EXPR_CASE(Xor)
+    BINARY_EXPR_CASE(Shl)
+    BINARY_EXPR_CASE(LShr)
+    BINARY_EXPR_CASE(AShr)
+    BINARY_EXPR_CASE(Eq)
+    BINARY_EXPR_CASE(Ne)
+    BINARY_EXPR_CASE(Ult)
+    BINARY_EXPR_CASE(Ule)
+    BINARY_EXPR_CASE(Ugt)
+    BINARY_EXPR_CASE(Uge)
+    BINARY_EXPR_CASE(Slt)
+    BINARY_EXPR_CASE(Sle)
+    BINARY_EXPR_CASE(Sgt)
+    BINARY_EXPR_CASE(Sge)
+#undef BINARY_EXPR_CASE
+    default: ok = false; break;
+    }
+    if (ok)
+      exprTable.push_back(e);
+  }
+
+  // Reads a reference to the expression table, 0 being a null expression.
+#define READ_VALUE(_dst)                                                     \
+  do {                                                                       \
+    uint64_t id;                                                             \
+    ok = ok && readRef(is, exprTable.size(), id);                            \
+    if (ok && id)                                                            \
+      _dst = exprTable[id - 1];                                              \
+  } while (0)
+
+  ok = ok && readVarint(is, count);
+  for (uint64_t i = 0; ok && i < count; ++i) {
+    callPath->calls.push_back(CallPathCall());
+    CallPathCall &call = callPath->calls.back();
+    ok = readString(is, call.function_name);
+
+    uint64_t numValues;
+    ok = ok && readVarint(is, numValues);
+    for (uint64_t j = 0; ok && j < numValues; ++j) {
+      std::string name;
+      ok = readString(is, name);
+      READ_VALUE(call.args[name].first);
+      READ_VALUE(call.args[name].second);
+    }
+
+    ok = ok && readVarint(is, numValues);
+    for (uint64_t j = 0; ok && j < numValues; ++j) {
+      std::string name;
+      ok = readString(is, name);
+      READ_VALUE(call.extra_vars[name].first);
+      READ_VALUE(call.extra_vars[name].second);
+      if (ok)
+        noteExtraVar(callPath, name, call.extra_vars[name].first);
+    }
+  }
+#undef READ_VALUE
+
+  std::vector<ref<Expr> > constraints;
+  ok = ok && readVarint(is, count);
+  for (uint64_t i = 0; ok && i < count; ++i) {
+    uint64_t id;
+    ok = readIndex(is, exprTable.size(), id);
+    if (ok)
+      constraints.push_back(exprTable[id]);
+  }
+
+  if (!ok) {
+    delete callPath;
+    return 0;
+  }
+  callPath->constraints = ConstraintManager(constraints);
+  error.clear();
+  return callPath;
+}
+
+CallPath *klee::loadCallPath(const std::string &fileName,
+                             const std::set<std::string> &symbols,
+                             const std::vector<std::string> &exprStrs,
+                             std::deque<ref<Expr> > &exprs,
+                             std::string &error) {
+  std::ifstream file(fileName.c_str(), std::ios::in | std::ios::binary);
+  if (!file.is_open()) {
+    error = "unable to open call path file " + fileName;
+    return 0;
+  }
+
+  CallPathLoader loader(symbols, exprStrs, exprs, error);
+  char magic[sizeof(BinaryMagic)];
+  file.read(magic, sizeof(magic));
+  if (file.gcount() == sizeof(magic) &&
+      std::equal(magic, magic + sizeof(magic), BinaryMagic))
+    return loader.loadBinary(file);
+
+  file.clear();
+  file.seekg(0);
+  return loader.loadText(file);
+}
+
+CallPath *klee::loadCallPath(const std::string &fileName, std::string &error) {
+  std::deque<ref<Expr> > exprs;
+  return loadCallPath(fileName, std::set<std::string>(),
+                      std::vector<std::string>(), exprs, error);
+}
@@ -0,0 +1,226 @@
+//===-- CallPathWriter.cpp ------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "BinaryFormat.h"
+
+#include "klee/CallPath.h"
+#include "klee/util/ExprHashMap.h"
+
+#include "llvm/Support/raw_ostream.h"
+
+#include <map>
+
+using namespace klee;
+using namespace klee::callpath;
+
+namespace {
+void writeVarint(llvm::raw_ostream &os, uint64_t value) {
+  do {
+    unsigned char byte = value & 0x7f;
+    value >>= 7;
+    if (value)
+      byte |= 0x80;
+    os << byte;
+  } while (value);
+}
+
+void writeString(llvm::raw_ostream &os, const std::string &s) {
+  writeVarint(os, s.size());
+  os << s;
+}
+
+/// Assigns the indices of the expression DAG. The node records are
+/// buffered, as the array table that precedes them is only complete once
+/// all the reads were seen.
+class BinaryCallPathWriter {
+  std::string nodeBuffer;
+  llvm::raw_string_ostream nodes;
+  unsigned numNodes;
+
+  ExprHashMap<unsigned> exprIds;
+  std::map<const UpdateNode *, unsigned> updateIds;
+  std::map<const Array *, unsigned> arrayIds;
+  std::vector<const Array *> arrays;
+
+  unsigned arrayId(const Array *array);
+  unsigned updatesRef(const UpdateNode *head);
+
+public:
+  BinaryCallPathWriter() : nodes(nodeBuffer), numNodes(0) {}
+
+  unsigned exprId(const ref<Expr> &e);
+  uint64_t exprRef(const ref<Expr> &e) {
+    return e.isNull() ? 0 : exprId(e) + 1;
+  }
+
+  void writeArraysAndNodes(llvm::raw_ostream &os);
+};
+
+unsigned BinaryCallPathWriter::arrayId(const Array *array) {
+  std::map<const Array *, unsigned>::iterator it = arrayIds.find(array);
+  if (it != arrayIds.end())
+    return it->second;
+  unsigned id = arrays.size();
+  arrayIds[array] = id;
+  arrays.push_back(array);
+  return id;
+}
+
+unsigned BinaryCallPathWriter::updatesRef(const UpdateNode *head) {
+  // The update lists of the reads of one array mostly share their tails,
+  // only write the nodes that were not written yet, oldest first.
+  std::vector<const UpdateNode *> pending;
+  for (const UpdateNode *un = head; un && !updateIds.count(un); un = un->next)
+    pending.push_back(un);
+
+  for (std::vector<const UpdateNode *>::reverse_iterator
+         it = pending.rbegin(), ie = pending.rend(); it != ie; ++it) {
+    const UpdateNode *un = *it;
+    unsigned index = exprId(un->index);
+    unsigned value = exprId(un->value);
+    unsigned id = updateIds.size();
+    writeVarint(nodes, UpdateRecord);
+    writeVarint(nodes, un->next ? updateIds[un->next] + 1 : 0);
+    writeVarint(nodes, index);
+    writeVarint(nodes, value);
+    ++numNodes;
+    updateIds[un] = id;
+  }
+  return head ? updateIds[head] + 1 : 0;
+}
+
+unsigned BinaryCallPathWriter::exprId(const ref<Expr> &e) {
+  ExprHashMap<unsigned>::iterator it = exprIds.find(e);
+  if (it != exprIds.end())
+    return it->second;
+
+  // The operands are written first, so that the reader never sees a
+  // reference to an expression it has not built yet.
+  std::vector<uint64_t> operands;
+  switch (e->getKind()) {
+  case Expr::Constant: {
+    const llvm::APInt &value = cast<ConstantExpr>(e)->getAPValue();
+    operands.push_back(value.getBitWidth());
+    for (unsigned i = 0; i < value.getNumWords(); ++i)
+      operands.push_back(value.getRawData()[i]);
+    break;
+  }
+  case Expr::Read: {
+    const ReadExpr *re = cast<ReadExpr>(e);
+    operands.push_back(arrayId(re->updates.root));
+    operands.push_back(updatesRef(re->updates.head));
+    operands.push_back(exprId(re->index));
+    break;
+  }
+  case Expr::Extract: {
+    const ExtractExpr *ee = cast<ExtractExpr>(e);
+    operands.push_back(exprId(ee->expr));
+    operands.push_back(ee->offset);
+    operands.push_back(ee->width);
+    break;
+  }
+  case Expr::ZExt:
+  case Expr::SExt: {
+    const CastExpr *ce = cast<CastExpr>(e);
+    operands.push_back(exprId(ce->src));
+    operands.push_back(ce->width);
+    break;
+  }
+  default:
+    for (unsigned i = 0; i < e->getNumKids(); ++i)
+      operands.push_back(exprId(e->getKid(i)));
+    break;
+  }
+
+  unsigned id = exprIds.size();
+  writeVarint(nodes, ExprRecord);
+  writeVarint(nodes, e->getKind());
+  for (std::vector<uint64_t>::iterator it = operands.begin(),
+         ie = operands.end(); it != ie; ++it)
+    writeVarint(nodes, *it);
+  ++numNodes;
+  exprIds[e] = id;
+  return id;
+}
+
+void BinaryCallPathWriter::writeArraysAndNodes(llvm::raw_ostream &os) {
+  writeVarint(os, arrays.size());
+  for (std::vector<const Array *>::iterator it = arrays.begin(),
+         ie = arrays.end(); it != ie; ++it) {
+    const Array *array = *it;
+    writeString(os, array->name);
+    writeVarint(os, array->size);
+    writeVarint(os, array->domain);
+    writeVarint(os, array->range);
+    writeVarint(os, array->constantValues.size());
+    for (unsigned i = 0; i < array->constantValues.size(); ++i)
+      writeVarint(os, array->constantValues[i]->getZExtValue());
+  }
+
+  writeVarint(os, numNodes);
+  os << nodes.str();
+}
+
+void writeValues(BinaryCallPathWriter &writer,
+                 const std::map<std::string, CallPathCall::BeforeAfter> &vals,
+                 std::vector<uint64_t> &refs) {
+  for (std::map<std::string, CallPathCall::BeforeAfter>::const_iterator
+         it = vals.begin(), ie = vals.end(); it != ie; ++it) {
+    refs.push_back(writer.exprRef(it->second.first));
+    refs.push_back(writer.exprRef(it->second.second));
+  }
+}
+}
+
+void klee::writeBinaryCallPath(llvm::raw_ostream &os,
+                               const std::vector<CallPathCall> &calls,
+                               const ConstraintManager &constraints) {
+  BinaryCallPathWriter writer;
+
+  // Build the DAG first, the calls and the constraints refer to it.
+  std::vector<uint64_t> callRefs;
+  for (std::vector<CallPathCall>::const_iterator it = calls.begin(),
+         ie = calls.end(); it != ie; ++it) {
+    writeValues(writer, it->args, callRefs);
+    writeValues(writer, it->extra_vars, callRefs);
+  }
+  std::vector<uint64_t> constraintRefs;
+  for (ConstraintManager::const_iterator it = constraints.begin(),
+         ie = constraints.end(); it != ie; ++it)
+    constraintRefs.push_back(writer.exprId(*it));
+
+  os.write(BinaryMagic, sizeof(BinaryMagic));
+  writeVarint(os, BinaryVersion);
+  writer.writeArraysAndNodes(os);
+
+  std::vector<uint64_t>::iterator callRef = callRefs.begin();
+  writeVarint(os, calls.size());
+  for (std::vector<CallPathCall>::const_iterator it = calls.begin(),
+         ie = calls.end(); it != ie; ++it) {
+    writeString(os, it->function_name);
+    const std::map<std::string, CallPathCall::BeforeAfter> *sections[] = {
+      &it->args, &it->extra_vars
+    };
+    for (unsigned s = 0; s < 2; ++s) {
+      writeVarint(os, sections[s]->size());
+      for (std::map<std::string, CallPathCall::BeforeAfter>::const_iterator
+             vi = sections[s]->begin(), ve = sections[s]->end();
+           vi != ve; ++vi) {
+        writeString(os, vi->first);
+        writeVarint(os, *callRef++);
+        writeVarint(os, *callRef++);
+      }
+    }
+  }
+
+  writeVarint(os, constraintRefs.size());
+  for (std::vector<uint64_t>::iterator it = constraintRefs.begin(),
+         ie = constraintRefs.end(); it != ie; ++it)
+    writeVarint(os, *it);
+}
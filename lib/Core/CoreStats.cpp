@@ -19,6 +19,15 @@ Statistic stats::forks("Forks", "Forks");
 Statistic stats::instructionRealTime("InstructionRealTimes", "Ireal");
 Statistic stats::instructionTime("InstructionTimes", "Itime");
 Statistic stats::instructions("Instructions", "I");
+Statistic stats::loopAnalysisCacheHits("LoopAnalysisCacheHits", "LAChits");
+Statistic stats::loopAnalysisBytesFiltered("LoopAnalysisBytesFiltered", "LAfiltered");
+Statistic stats::loopAnalysisDiffBytes("LoopAnalysisDiffBytes", "LAbytes");
+Statistic stats::loopAnalysisPathsSkipped("LoopAnalysisPathsSkipped", "LAskip");
+Statistic stats::loopAnalysisQueries("LoopAnalysisQueries", "LAQ");
+Statistic stats::loopAnalysisQueriesSaved("LoopAnalysisQueriesSaved", "LAQsaved");
+Statistic stats::loopAnalysisSummariesApplied("LoopAnalysisSummariesApplied", "LAsummaries");
+Statistic stats::loopAnalysisTimeouts("LoopAnalysisTimeouts", "LAtimeouts");
+Statistic stats::loopAnalysisWorkerPaths("LoopAnalysisWorkerPaths", "LAworker");
 Statistic stats::minDistToReturn("MinDistToReturn", "Rdist");
 Statistic stats::minDistToUncovered("MinDistToUncovered", "UCdist");
 Statistic stats::reachableUncovered("ReachableUncovered", "IuncovReach");
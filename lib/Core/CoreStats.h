@@ -47,6 +47,40 @@ namespace stats {
   /// distance to a function return.
   extern Statistic minDistToReturn;
 
+  /// The number of solver queries issued while comparing memory
+  /// between loop invariant analysis rounds.
+  extern Statistic loopAnalysisQueries;
+
+  /// The number of structurally different bytes checked while
+  /// comparing memory between loop invariant analysis rounds.
+  extern Statistic loopAnalysisDiffBytes;
+
+  /// The number of structurally different bytes proven equal without
+  /// the solver, by normalizing the reads or by the path constraints.
+  extern Statistic loopAnalysisBytesFiltered;
+
+  /// The number of per-byte solver queries avoided by checking whole
+  /// runs of bytes at once.
+  extern Statistic loopAnalysisQueriesSaved;
+
+  /// The number of loop invariant analysis diff queries that timed out.
+  extern Statistic loopAnalysisTimeouts;
+
+  /// The number of loop invariant analysis paths skipped because they
+  /// could not read any of the newly forgotten bytes.
+  extern Statistic loopAnalysisPathsSkipped;
+
+  /// The number of loop entries that reused the forget mask of an
+  /// earlier analysis of the loop.
+  extern Statistic loopAnalysisSummariesApplied;
+
+  /// The number of loop analyses seeded from the --loop-invariant-cache.
+  extern Statistic loopAnalysisCacheHits;
+
+  /// The number of loop invariant analysis paths explored by worker
+  /// processes, see --loop-analysis-workers.
+  extern Statistic loopAnalysisWorkerPaths;
+
 }
 }
 
@@ -19,6 +19,8 @@
 #include "klee/Internal/Module/InstructionInfoTable.h"
 #include "klee/Internal/Module/KInstruction.h"
 #include "klee/Internal/Module/KModule.h"
+#include "klee/Internal/Support/Timer.h"
+#include "CoreStats.h"
 #include "TimingSolver.h"
 #include "klee/LoopAnalysis.h"
 
@@ -31,9 +33,11 @@
 #include "llvm/Support/raw_ostream.h"
 
 #include <algorithm>
+#include <cstring>
 #include <iomanip>
 #include <sstream>
 #include <cassert>
+#include <functional>
 #include <map>
 #include <regex>
 #include <set>
@@ -46,6 +50,22 @@ using namespace klee;
 namespace { 
   cl::opt<bool>
   DebugLogStateMerge("debug-log-state-merge");
+
+  cl::opt<bool>
+  ReuseLoopSummaries("loop-analysis-reuse-summaries",
+                     cl::desc("Apply the forget mask of an already analysed "
+                              "loop directly, without the analysis rounds, "
+                              "when the loop is entered again in a "
+                              "compatible state (default=off)"),
+                     cl::init(false));
+
+  cl::opt<bool>
+  SkipUnaffectedLoopPaths("loop-analysis-skip-unaffected-paths",
+                          cl::desc("In a loop invariant analysis round, skip "
+                                   "the paths that did not read any newly "
+                                   "forgotten byte in the previous round "
+                                   "(default=off)"),
+                          cl::init(false));
 }
 
 /***/
@@ -79,6 +99,7 @@ ExecutionState::ExecutionState(KFunction *kf) :
     prevPC(pc),
 
     executionStateForLoopInProcess(0),
+    loopPathSkipped(false),
 
     queryCost(0.),
     weight(1),
@@ -97,6 +118,7 @@ ExecutionState::ExecutionState(KFunction *kf) :
 
 ExecutionState::ExecutionState(const std::vector<ref<Expr> > &assumptions)
   : executionStateForLoopInProcess(0),
+    loopPathSkipped(false),
     constraints(assumptions),
     queryCost(0.), ptreeNode(0),
     relevantSymbols(),
@@ -151,7 +173,11 @@ ExecutionState::ExecutionState(const ExecutionState& state):
     loopInProcess(state.loopInProcess) ,
     analysedLoops(state.analysedLoops),
     executionStateForLoopInProcess(0),
+    loopPathBranches(state.loopPathBranches),
+    loopPathReads(state.loopPathReads),
+    loopPathSkipped(state.loopPathSkipped),
     constraints(state.constraints),
+    constraintSlices(state.constraintSlices),
 
     queryCost(state.queryCost),
     weight(state.weight),
@@ -220,6 +246,11 @@ ExecutionState *ExecutionState::branch() {
   weight *= .5;
   falseState->weight -= weight;
 
+  if (!loopInProcess.isNull()) {
+    loopPathBranches.push_back(false);
+    falseState->loopPathBranches.push_back(true);
+  }
+
   return falseState;
 }
 
@@ -239,6 +270,26 @@ void ExecutionState::addSymbolic(const MemoryObject *mo, const Array *array) {
   mo->refCount++;
   symbolics.push_back(std::make_pair(mo, array));
 }
+
+void ExecutionState::recordLoopRead(const MemoryObject *mo, ref<Expr> offset,
+                                    unsigned bytes) {
+  if (loopInProcess.isNull()) return;
+  if (ConstantExpr *CE = dyn_cast<ConstantExpr>(offset)) {
+    loopPathReads.record(mo, CE->getZExtValue(), bytes);
+  } else {
+    loopPathReads.recordObject(mo);
+  }
+}
+
+void ExecutionState::recordLoopReadObject(const MemoryObject *mo) {
+  if (loopInProcess.isNull()) return;
+  loopPathReads.recordObject(mo);
+}
+
+void ExecutionState::recordLoopReadAll() {
+  if (loopInProcess.isNull()) return;
+  loopPathReads.all = true;
+}
 ///
 
 std::string ExecutionState::getFnAlias(std::string fn) {
@@ -535,39 +586,10 @@ void ExecutionState::dumpStack(llvm::raw_ostream &out) const {
   }
 }
 
-bool symbolSetsIntersect(const SymbolSet& a, const SymbolSet& b) {
-  if (a.size() > b.size()) return symbolSetsIntersect(b, a);
-  for (SymbolSet::const_iterator i = a.begin(), e = a.end(); i != e; ++i) {
-    if (b.count(*i)) return true;
-  }
-  return false;
-}
-
 std::vector<ref<Expr> > ExecutionState::
 relevantConstraints(SymbolSet symbols) const {
-  std::vector<ref<Expr> > ret;
-  llvm::SmallPtrSet<Expr*, 100> insertedConstraints;
-  bool newSymbols = false;
-  do {
-    newSymbols = false;
-    for (ConstraintManager::constraint_iterator ci = constraints.begin(),
-           cEnd = constraints.end(); ci != cEnd; ++ci) {
-      if (insertedConstraints.count((*ci).get())) continue;
-      SymbolSet constrainedSymbols = GetExprSymbols::visit(*ci);
-      if (symbolSetsIntersect(constrainedSymbols, symbols)) {
-        for (SymbolSet::const_iterator csi = constrainedSymbols.begin(),
-               cse = constrainedSymbols.end();
-             csi != cse; ++csi) {
-          bool inserted = symbols.insert(*csi);
-          newSymbols = newSymbols || inserted;
-        }
-        symbols.insert(constrainedSymbols.begin(), constrainedSymbols.end());
-        ret.push_back(*ci);
-        insertedConstraints.insert((*ci).get());
-      }
-    }
-  } while (newSymbols);
-  return ret;
+  // The constraints transitively sharing arrays with the symbols.
+  return constraintSlices.getSlice(constraints, symbols);
 }
 
 bool ExecutionState::isAccessibleAddr(ref<Expr> addr) const {
@@ -595,11 +617,13 @@ ref<Expr> ExecutionState::readMemoryChunk(ref<Expr> addr,
 }
 
 void ExecutionState::traceRet() {
-  if (callPath.empty() ||
-      callPath.back().returned ||
-      callPath.back().f != stack.back().kf->function) {
-    if (!callPath.empty()) {
-      SymbolSet symbols = callPath.back().computeRetSymbolSet();
+  // Only read here, not to unshare the last call.
+  const SharedPrefixList<CallInfo> &path = callPath;
+  if (path.empty() ||
+      path.back().returned ||
+      path.back().f != stack.back().kf->function) {
+    if (!path.empty()) {
+      SymbolSet symbols = path.back().computeRetSymbolSet();
       relevantSymbols.insert(symbols.begin(), symbols.end());
     }
     callPath.push_back(CallInfo());
@@ -1254,9 +1278,17 @@ ExecutionState* ExecutionState::finishLoopRound(KFunction *kf) {
   // on this loop, even though there are paths that avoid that infinite loop,
   // and the search heuristic may guide execution away.
   if (analysisFinished) {
-    kf->insert(loopInProcess->getLoop(),
-               loopInProcess->getChangedBytes(),
-               loopInProcess->getEntryState());
+    const ExecutionState &entryState = loopInProcess->getEntryState();
+    entryState.stack.back().kf->insert(loopInProcess->getLoop(),
+                                       loopInProcess->getChangedBytes(),
+                                       entryState);
+    storeCachedInvariant(loopInProcess->getLoop(),
+                         entryState.stack.back().kf,
+                         entryState,
+                         loopInProcess->getChangedBytes());
+    recordLoopAnalysis(loopInProcess->getLoop(),
+                       entryState.stack.back().kf,
+                       loopInProcess->getProfile());
     LOG_LA("[" << loopInProcess->getLoop() << "]analysis finished, loop inserted");
   }
   return nextRoundState;
@@ -1285,6 +1317,18 @@ void ExecutionState::loopRepetition(const llvm::Loop *dstLoop,
   *terminate = false;
 }
 
+size_t ExecutionState::getFinalCallPathSize() const {
+  size_t size = callPath.empty() ? 0 : callPath.size() - 1;
+  // The saved states resume from the calls they had when they were saved,
+  // their last call may since have been traced further by this state.
+  if (executionStateForLoopInProcess)
+    size = std::min(size, executionStateForLoopInProcess->getFinalCallPathSize());
+  for (ref<LoopInProcess> lip = loopInProcess; !lip.isNull();
+       lip = lip->getOuter())
+    size = std::min(size, lip->getEntryState().getFinalCallPathSize());
+  return size;
+}
+
 void ExecutionState::loopEnter(const llvm::Loop *dstLoop) {
   LOG_LA("Loop enter");
   // Get ready for the next analysis run, which may have
@@ -1292,10 +1336,14 @@ void ExecutionState::loopEnter(const llvm::Loop *dstLoop) {
   LOG_LA("Remove the loop from the analyzed set - prepare"
          " to repeat the analysis.");
   analysedLoops = analysedLoops.remove(dstLoop);
+  // Only the loops with a klee_induce_invariants call may need the
+  // entry state, do not pay for cloning on all the other loops.
+  if (!stack.back().kf->mayInduceInvariants(dstLoop)) return;
   /// Remember the initial state for this loop header in
   /// case ther is an klee_induce_invariants call following.
   LOG_LA("store the loop-head entering state,"
          " just in case.");
+  delete executionStateForLoopInProcess;
   executionStateForLoopInProcess = branch();
   executionStateForLoopInProcess->loopInProcess = 0;
 }
@@ -1322,6 +1370,14 @@ void ExecutionState::updateLoopAnalysisForBlockTransfer
   const llvm::Loop *dstLoop = kf->loopInfo.getLoopFor(dst);
   const llvm::Loop *srcLoop = kf->loopInfo.getLoopFor(src);
   *terminate = false;
+  if (!loopInProcess.isNull() && loopInProcess->isUnaffectedPath(*this)) {
+    LOG_LA("[" << loopInProcess->getLoop() << "]Skipping a path unaffected"
+           " by the newly forgotten bytes.");
+    ++stats::loopAnalysisPathsSkipped;
+    loopPathSkipped = true;
+    *terminate = true;
+    return;
+  }
   if (srcLoop) {
     if (dstLoop) {
       if (srcLoop == dstLoop) {
@@ -1367,13 +1423,15 @@ void ExecutionState::updateLoopAnalysisForBlockTransfer
 void ExecutionState::terminateState(ExecutionState** replace) {
   LOG_LA("Terminating: " << (void*)this);
   if (!loopInProcess.isNull()) {
+    loopInProcess->recordPath(*this);
     *replace = finishLoopRound(stack.back().kf);
     loopInProcess = 0;
     LOG_LA(" - replacing with: " <<(void*)(*replace));
   }
 }
 
-void ExecutionState::startInvariantSearch() {
+void ExecutionState::startInvariantSearch(bool *terminate) {
+  *terminate = false;
   KInstruction *inst = prevPC;
   llvm::Instruction *linst = inst->inst;
   assert(linst);
@@ -1404,18 +1462,32 @@ void ExecutionState::startInvariantSearch() {
            "The klee_induce_invariants must be placed into the condition"
            " of a loop.");
 
+    if (!loopInProcess.isNull()) loopInProcess->markNestedAnalysis();
     loopInProcess =
       new LoopInProcess(loop,
                         executionStateForLoopInProcess,
                         loopInProcess);
     executionStateForLoopInProcess = 0;
+    LoopEntryState *summary =
+      ReuseLoopSummaries ? kf->analysedStateFor(loop) : 0;
+    if (summary &&
+        summary->appliesTo(loopInProcess->getEntryState(), loop, kf)) {
+      LOG_LA("Reusing the summary of the earlier analysis.");
+      ++stats::loopAnalysisSummariesApplied;
+      loopInProcess->applySummary(summary->forgetMask);
+      // This path is replaced by the havoced restart state.
+      *terminate = true;
+    } else {
+      loopInProcess->loadCachedChangedBytes(kf);
+    }
   } else {
     LOG_LA("Already analysed, or being analysed at this very moment");
   }
 }
 
-void ExecutionState::induceInvariantsForThisLoop(KInstruction *target) {
-  startInvariantSearch();
+void ExecutionState::induceInvariantsForThisLoop(KInstruction *target,
+                                                 bool *terminate) {
+  startInvariantSearch(terminate);
 
   //The return value of the intrinsic function call.
   stack.back().locals[target->dest].value =
@@ -1550,7 +1622,7 @@ CallArg* CallInfo::getCallArgPtrp(ref<Expr> ptr) {
 bool equalContexts(const std::vector<ref<Expr> >& a,
                    const std::vector<ref<Expr> >& b) {
   // TODO: Structural-only comparison here, ideally we'd ask the solver about it
-  if (a.size() != b.size()) return false;
+  // The contexts are compared as sets, duplicates do not count.
   for (unsigned i = 0; i < a.size(); ++i) {
     bool notFound = true;
     for (unsigned j = 0; j < b.size(); ++j) {
@@ -1564,7 +1636,7 @@ bool equalContexts(const std::vector<ref<Expr> >& a,
   for (unsigned i = 0; i < b.size(); ++i) {
     bool notFound = true;
     for (unsigned j = 0; j < a.size(); ++j) {
-      if ((*a[i]).compare(*b[j]) == 0) {
+      if ((*b[i]).compare(*a[j]) == 0) {
         notFound = false;
         break;
       }
@@ -1615,6 +1687,102 @@ bool CallInfo::sameInvocation(const CallInfo* other) const {
   return equalContexts(callContext, other->callContext);
 }
 
+static unsigned combineHash(unsigned res, unsigned value) {
+  return res * Expr::MAGIC_HASH_CONSTANT + value;
+}
+
+static unsigned hashOf(const ref<Expr> &e) {
+  return e.isNull() ? 0 : e->hash();
+}
+
+static unsigned hashOf(const std::string &s) {
+  return std::hash<std::string>()(s);
+}
+
+static unsigned hashContext(const std::vector<ref<Expr> > &context) {
+  std::vector<unsigned> hashes;
+  for (unsigned i = 0; i < context.size(); ++i)
+    hashes.push_back(context[i]->hash());
+  std::sort(hashes.begin(), hashes.end());
+  hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+  unsigned res = 0;
+  for (unsigned i = 0; i < hashes.size(); ++i)
+    res = combineHash(res, hashes[i]);
+  return res;
+}
+
+unsigned FieldDescr::sameInvocationHash() const {
+  unsigned res = width;
+  res = combineHash(res, hashOf(name));
+  res = combineHash(res, hashOf(type));
+  res = combineHash(res, doTraceValueIn);
+  if (doTraceValueIn)
+    res = combineHash(res, hashOf(inVal));
+  return res;
+}
+
+unsigned FieldDescr::hash() const {
+  unsigned res = combineHash(sameInvocationHash(), doTraceValueOut);
+  if (doTraceValueOut)
+    res = combineHash(res, hashOf(outVal));
+  return res;
+}
+
+unsigned CallArg::hash() const {
+  unsigned res = combineHash(hashOf(expr), isPtr);
+  if (isPtr)
+    res = combineHash(res, pointee.hash());
+  return res;
+}
+
+unsigned CallArg::sameInvocationHash() const {
+  unsigned res = combineHash(hashOf(expr), isPtr);
+  if (isPtr)
+    res = combineHash(res, pointee.sameInvocationHash());
+  return res;
+}
+
+unsigned RetVal::hash() const {
+  unsigned res = combineHash(hashOf(expr), isPtr);
+  if (isPtr)
+    res = combineHash(res, pointee.hash());
+  return res;
+}
+
+unsigned CallExtraPtr::hash() const {
+  unsigned res = ptr;
+  res = combineHash(res, accessibleIn);
+  res = combineHash(res, accessibleOut);
+  res = combineHash(res, pointee.hash());
+  return combineHash(res, hashOf(name));
+}
+
+unsigned CallInfo::computeHash() const {
+  unsigned res = (unsigned)(uintptr_t)f;
+  for (unsigned i = 0; i < args.size(); ++i)
+    res = combineHash(res, args[i].hash());
+  for (std::map<size_t, CallExtraPtr>::const_iterator i = extraPtrs.begin(),
+         e = extraPtrs.end(); i != e; ++i)
+    res = combineHash(combineHash(res, i->first), i->second.hash());
+  res = combineHash(res, ret.hash());
+  res = combineHash(res, hashContext(callContext));
+  res = combineHash(res, hashContext(returnContext));
+  return combineHash(res, returned);
+}
+
+unsigned CallInfo::computeSameInvocationHash() const {
+  unsigned res = (unsigned)(uintptr_t)f;
+  for (unsigned i = 0; i < args.size(); ++i)
+    res = combineHash(res, args[i].sameInvocationHash());
+  return combineHash(res, hashContext(callContext));
+}
+
+void CallInfo::cacheHashes() {
+  assert(returned && "The call may still change.");
+  hashValue = computeHash();
+  sameInvocationHashValue = computeSameInvocationHash();
+}
+
 SymbolSet CallInfo::computeRetSymbolSet() const {
   assert(returned && "incomplete");
   SymbolSet symbols;
@@ -1645,7 +1813,8 @@ LoopInProcess::LoopInProcess(const llvm::Loop *_loop,
                              ExecutionState *_headerState,
                              const ref<LoopInProcess> &_outer)
   :refCount(0), outer(_outer), loop(_loop), restartState(_headerState),
-   lastRoundUpdated(false)
+   lastRoundUpdated(false), round(0), nestedAnalysis(false),
+   pathsInWorkers(false)
 {
   //TODO: this can not belong here. It has nothing to do with execution state,
   // nor with ptree node.
@@ -1659,10 +1828,33 @@ LoopInProcess::~LoopInProcess() {
        i != e; ++i) {
     delete i->second;
   }
+  for (StateByteMask::iterator i = roundStartBytes.begin(),
+         e = roundStartBytes.end(); i != e; ++i) {
+    delete i->second;
+  }
   assert(restartState);
   delete restartState;
 }
 
+void LoopInProcess::loadCachedChangedBytes(KFunction *kf) {
+  if (lookupCachedInvariant(loop, kf, *restartState, &changedBytes)) {
+    LOG_LA("[" << loop << "]Seeded the forget mask from the cache.");
+    ++stats::loopAnalysisCacheHits;
+    profile.cacheHit = true;
+    // Make sure at least one round runs with the cached mask forgotten,
+    // to confirm that it is still an invariant.
+    lastRoundUpdated = true;
+  }
+}
+
+void LoopInProcess::applySummary(const StateByteMask &forgetMask) {
+  for (StateByteMask::const_iterator i = forgetMask.begin(),
+         e = forgetMask.end(); i != e; ++i)
+    changedBytes[i->first] = new BitArray(*i->second, i->first->size);
+  // The mask is known to be a fixpoint, finish at the end of this round.
+  lastRoundUpdated = false;
+}
+
 unsigned countBitsSet(const BitArray *arr, unsigned size) {
   unsigned rez = 0;
   for (unsigned i = 0; i < size; ++i) {
@@ -1673,6 +1865,9 @@ unsigned countBitsSet(const BitArray *arr, unsigned size) {
 
 ExecutionState *LoopInProcess::makeRestartState() {
   ExecutionState *newState = restartState->branch();
+  newState->loopPathBranches.clear();
+  newState->loopPathReads = LoopPathReads();
+  newState->loopPathSkipped = false;
   LOG_LA("Making restart state " << (void*)newState <<" from " <<(void*)restartState);
   for (std::map<const MemoryObject *, BitArray *>::iterator
          i = changedBytes.begin(),
@@ -1729,6 +1924,7 @@ ExecutionState *LoopInProcess::makeRestartState() {
     LOG_LA("[" << loop << "]Some more objects were changed."
            " repeat the loop.");
     lastRoundUpdated = false;
+    ++round;
     //This works, because refCount is the internal field.
     newState->loopInProcess = this;
   } else {
@@ -1741,199 +1937,134 @@ ExecutionState *LoopInProcess::makeRestartState() {
   return newState;
 }
 
-std::string __attribute__((weak)) numToStr(long long n) {
-  std::stringstream ss;
-  ss << n;
-  return ss.str();
-}
-
-//TODO: move this into not-yet existing LoopAnalysis.cpp
-bool klee::updateDiffMask(StateByteMask* mask,
-                          const AddressSpace& refValues,
-                          const ExecutionState& state,
-                          TimingSolver* solver) {
-  bool updated = false;
-  for (MemoryMap::iterator
-         i = refValues.objects.begin(),
-         e = refValues.objects.end();
-       i != e; ++i) {
-    const MemoryObject *obj = i->first;
-    const ObjectState *refOs = i->second;
-    const ObjectState *os = state.addressSpace.findObject(obj);
-    if (refOs == os) continue;
-    if (refOs->isAccessible() != os->isAccessible()) {
-      std::string inacc_msg;
-      if (refOs->isAccessible()) {
-        inacc_msg = "cand " + os->inaccessible_message;
-      } else {
-        inacc_msg = "ref " + refOs->inaccessible_message;
+void LoopInProcess::updateChangedObjects(const ExecutionState& current,
+                                         TimingSolver* solver) {
+  WallTimer timer;
+  uint64_t queriesBefore = stats::loopAnalysisQueries;
+  uint64_t savedBefore = stats::loopAnalysisQueriesSaved;
+  bool updated = updateDiffMask(&changedBytes,
+                                restartState->addressSpace,
+                                current,
+                                solver,
+                                &diffContext);
+  if (updated) lastRoundUpdated = true;
+  if (loopAnalysisStatsEnabled()) {
+    profile.rounds.back().queries +=
+      stats::loopAnalysisQueries - queriesBefore;
+    profile.rounds.back().diffTime += timer.check();
+    profile.rounds.back().queriesSaved +=
+      stats::loopAnalysisQueriesSaved - savedBefore;
+  }
+}
+
+void LoopInProcess::recordPath(const ExecutionState &state) {
+  if (!SkipUnaffectedLoopPaths || nestedAnalysis || round == 0) return;
+  if (!state.loopPathSkipped) {
+    LoopPath path;
+    path.branches = state.loopPathBranches;
+    path.reads = state.loopPathReads;
+    roundPaths.push_back(path);
+    return;
+  }
+  ++profile.rounds.back().pathsSkipped;
+  // The skipped path would have repeated the paths of the last round
+  // that start with the same branches, carry them over.
+  const std::vector<bool> &prefix = state.loopPathBranches;
+  for (unsigned i = 0; i < lastRoundPaths.size(); ++i) {
+    const std::vector<bool> &branches = lastRoundPaths[i].branches;
+    if (branches.size() >= prefix.size() &&
+        std::equal(prefix.begin(), prefix.end(), branches.begin()))
+      roundPaths.push_back(lastRoundPaths[i]);
+  }
+}
+
+bool LoopInProcess::isUnaffectedPath(const ExecutionState &state) const {
+  if (lastRoundTrie.empty()) return false;
+  int node = 0;
+  const std::vector<bool> &branches = state.loopPathBranches;
+  for (unsigned i = 0; i < branches.size(); ++i) {
+    node = lastRoundTrie[node].children[branches[i]];
+    // A path the last round did not take, it must be explored.
+    if (node < 0) return false;
+  }
+  return !lastRoundTrie[node].affected;
+}
+
+/// Prepare the skipping of the paths of the next round that can not
+/// read any of the bytes forgotten since the start of this round. Such
+/// paths behave exactly as in this round, and can not extend the mask.
+void LoopInProcess::prepareIncrementalRound() {
+  lastRoundTrie.clear();
+  lastRoundPaths.clear();
+  if (!SkipUnaffectedLoopPaths || nestedAnalysis) return;
+
+  // The branches of the paths explored by workers are unknown.
+  if (round > 0 && !pathsInWorkers) {
+    StateByteMask newBytes;
+    for (StateByteMask::iterator i = changedBytes.begin(),
+           e = changedBytes.end(); i != e; ++i) {
+      const MemoryObject *mo = i->first;
+      StateByteMask::iterator before = roundStartBytes.find(mo);
+      BitArray *added = new BitArray(mo->size);
+      for (unsigned j = 0; j < mo->size; ++j) {
+        if (i->second->get(j) &&
+            (before == roundStartBytes.end() || !before->second->get(j)))
+          added->set(j);
       }
-      printf("No support for accessibility alternation "
-             "between loop iterations. Inaccessibility reason: %s\n",
-             inacc_msg.c_str());
-      exit(1);
+      newBytes[mo] = added;
     }
-    assert(refOs->isAccessible() == os->isAccessible() &&
-           "No support for accessibility alteration "
-           "between loop iterations.");
-    //printf("inserting %p\n", obj);
-    std::pair<std::map<const MemoryObject *, BitArray *>::iterator, bool>
-      insRez = mask->insert
-      (std::pair<const MemoryObject *, BitArray *>(obj, 0));
-
-
-    if (insRez.second) insRez.first->second =
-                         new BitArray(obj->size);
-    BitArray *bytes = insRez.first->second;
-    assert(bytes != 0);
-    unsigned size = obj->size;
-    for (unsigned j = 0; j < size; ++j) {
-      if (bytes->get(j)) continue;
-      ref<Expr> refVal = refOs->read8(j, true);
-      ref<Expr> val = os->read8(j, true);
-      if (0 != refVal->compare(*val)) {
-        //So: this byte was not diferent on the previous round,
-        // it also differs structuraly now. It is time to make
-        // sure it can be really different.
-
-        solver->setTimeout(0.01);//TODO: determine a correct argument here.
-        bool mayDiffer = true;
-        bool solverRes = solver->mayBeFalse(state, EqExpr::create(refVal, val),
-                                            /*&*/mayDiffer);
-        solver->setTimeout(0);
-        //assert(solverRes &&
-        //       "Solver failed in computing whether a byte changed or not.");
-        if (solverRes && mayDiffer) {
-          bytes->set(j);
-          updated = true;
-
-#if 0
-        fprintf(stderr, "%p Obj size: %d vs. %d\n", obj, refOs->size, os->size);
-        fflush(stderr);
-        fprintf(stderr, "%d byte before: ", j);
-        fflush(stderr);
-        refVal->dump();
-        fprintf(stderr, "%d byte after: ", j);
-        fflush(stderr);
-        val->dump();
-#endif//0
-
-          if (state.havocs.find(obj) == state.havocs.end() &&
-              !state.condoneUndeclaredHavocs) {
-            fprintf(stderr, "Obj size: %d vs. %d\n", refOs->size, os->size);
-            fflush(stderr);
-            fprintf(stderr, "%d byte before: ", j);
-            fflush(stderr);
-            refVal->dump();
-            fprintf(stderr, "%d byte after: ", j);
-            fflush(stderr);
-            val->dump();
-            fprintf(stderr, "full value before: ");
-            if (refOs->size < 100) {
-              refOs->read(0, refOs->size*8, true)->dump();
-            } else {
-              fprintf(stderr, "too long\n");
-            }
-            fprintf(stderr, "full value after: ");
-            if (os->size < 100 ) {
-              os->read(0, os->size*8, true)->dump();
-            } else {
-              fprintf(stderr, "too long\n");
-            }
-            fprintf(stderr, "Type: ");
-            fflush(stderr);
-            obj->allocSite->getType()->dump();
-            fprintf(stderr, "\n");
-            std::string metadata;
-            if (isa<llvm::Instruction>(obj->allocSite)) {
-              const llvm::Instruction *inst = dyn_cast<llvm::Instruction>(obj->allocSite);
-              if (llvm::MDNode *node = inst->getMetadata("dbg")) {
-                llvm::DILocation loc(node);
-                metadata = loc.getDirectory().str() + "/" +
-                  loc.getFilename().str() + ":" +
-                  numToStr(loc.getLineNumber());
-              } else {
-                const llvm::Function* fun = inst->getParent()->getParent();
-                metadata = "in function: " + fun->getName().str();
-              }
-            } else {
-              metadata = "(not an instruciton)";
-            }
-            klee_error("Unexpected memory location changed its value during invariant analysis:\n"
-                       "  name: %s\n  location: %s\n"
-                       "  local: %s\n  global: %s\n"
-                       "  fixed: %s\n  size: %u\n"
-                       "  address: 0x%lx\n  metadata: %s",
-                       obj->name.c_str(),
-                       obj->allocSite->getName().str().c_str(),
-                       obj->isLocal ? "true" : "false",
-                       obj->isGlobal ? "true" : "false",
-                       obj->isFixed ? "true" : "false",
-                       obj->size,
-                       obj->address,
-                       metadata.c_str());
-          }
-          if (state.noHavocs.find(obj) != state.noHavocs.end()) {
-            fprintf(stderr, "Obj size: %d vs. %d\n", refOs->size, os->size);
-            fflush(stderr);
-            fprintf(stderr, "%d byte before: ", j);
-            fflush(stderr);
-            refVal->dump();
-            fprintf(stderr, "%d byte after: ", j);
-            fflush(stderr);
-            val->dump();
-            fprintf(stderr, "Type: ");
-            fflush(stderr);
-            obj->allocSite->getType()->dump();
-            fprintf(stderr, "\n");
-            std::string metadata;
-            if (isa<llvm::Instruction>(obj->allocSite)) {
-              const llvm::Instruction *inst = dyn_cast<llvm::Instruction>(obj->allocSite);
-              if (llvm::MDNode *node = inst->getMetadata("dbg")) {
-                llvm::DILocation loc(node);
-                metadata = loc.getDirectory().str() + "/" +
-                  loc.getFilename().str() + ":" +
-                  numToStr(loc.getLineNumber());
-              } else {
-                metadata = "(unknown)";
-              }
-            } else {
-              metadata = "(not an instruciton)";
-            }
-            klee_error("Guaranteed invariant (never-havoc %s) changed during invariant analysis:\n"
-                       "  name: %s\n  location: %s\n"
-                       "  local: %s\n  global: %s\n"
-                       "  fixed: %s\n  size: %u\n"
-                       "  address: 0x%lx\n  metadata: %s",
-                       (*state.noHavocs.find(obj)).second.c_str(),
-                       obj->name.c_str(),
-                       obj->allocSite->getName().str().c_str(),
-                       obj->isLocal ? "true" : "false",
-                       obj->isGlobal ? "true" : "false",
-                       obj->isFixed ? "true" : "false",
-                       obj->size,
-                       obj->address,
-                       metadata.c_str());
-          }
+
+    PathNode root = {{-1, -1}, false};
+    lastRoundTrie.push_back(root);
+    for (unsigned p = 0; p < roundPaths.size(); ++p) {
+      bool affected = roundPaths[p].reads.intersects(newBytes);
+      int node = 0;
+      lastRoundTrie[node].affected |= affected;
+      const std::vector<bool> &branches = roundPaths[p].branches;
+      for (unsigned i = 0; i < branches.size(); ++i) {
+        int child = lastRoundTrie[node].children[branches[i]];
+        if (child < 0) {
+          PathNode fresh = {{-1, -1}, false};
+          child = lastRoundTrie.size();
+          lastRoundTrie.push_back(fresh);
+          lastRoundTrie[node].children[branches[i]] = child;
         }
+        node = child;
+        lastRoundTrie[node].affected |= affected;
       }
     }
+    if (roundPaths.empty()) {
+      lastRoundTrie.clear();
+    } else if (!lastRoundTrie[0].affected) {
+      LOG_LA("[" << loop << "]No path read the newly forgotten bytes,"
+             " the next round would repeat this one.");
+      lastRoundUpdated = false;
+      lastRoundTrie.clear();
+    }
+    for (StateByteMask::iterator i = newBytes.begin(), e = newBytes.end();
+         i != e; ++i)
+      delete i->second;
   }
-  return updated;
-}
 
-void LoopInProcess::updateChangedObjects(const ExecutionState& current,
-                                         TimingSolver* solver) {
-  bool updated = updateDiffMask(&changedBytes,
-                                restartState->addressSpace,
-                                current,
-                                solver);
-  if (updated) lastRoundUpdated = true;
+  lastRoundPaths.swap(roundPaths);
+  roundPaths.clear();
+  for (StateByteMask::iterator i = roundStartBytes.begin(),
+         e = roundStartBytes.end(); i != e; ++i)
+    delete i->second;
+  roundStartBytes.clear();
+  for (StateByteMask::iterator i = changedBytes.begin(),
+         e = changedBytes.end(); i != e; ++i)
+    roundStartBytes[i->first] = new BitArray(*i->second, i->first->size);
 }
 
 ExecutionState *LoopInProcess::nextRoundState(bool *analysisFinished) {
+  ++profile.rounds.back().paths;
   if (refCount == 1) {
     //The last state in the round.
+    if (retryDeferredDiffs(&changedBytes, &diffContext))
+      lastRoundUpdated = true;
+    if (lastRoundUpdated) prepareIncrementalRound();
+    pathsInWorkers = false;
     if (!lastRoundUpdated) {
       LOG_LA("[" << loop << "]Fixpoint reached. Time to"
              " restart the iteration in the normal mode.");
@@ -1941,6 +2072,16 @@ ExecutionState *LoopInProcess::nextRoundState(bool *analysisFinished) {
     } else {
       *analysisFinished = false;
     }
+    if (loopAnalysisStatsEnabled()) {
+      unsigned maskBytes = 0;
+      for (StateByteMask::const_iterator i = changedBytes.begin(),
+             e = changedBytes.end(); i != e; ++i)
+        maskBytes += countBitsSet(i->second, i->first->size);
+      profile.rounds.back().bytesAdded = maskBytes - profile.maskBytes;
+      profile.maskBytes = maskBytes;
+      if (!*analysisFinished)
+        profile.rounds.push_back(LoopAnalysisProfile::Round());
+    }
     // Order is important; makeRestartState clears the
     // lastRoundUpdated flag.
     LOG_LA("[" << loop << "]Schedule a fresh copy of the"
@@ -1951,6 +2092,122 @@ ExecutionState *LoopInProcess::nextRoundState(bool *analysisFinished) {
   return 0;
 }
 
+/// The statistics a worker process counts on behalf of the main process.
+static Statistic *const workerStats[] = {
+  &stats::loopAnalysisWorkerPaths,
+  &stats::loopAnalysisQueries,
+  &stats::loopAnalysisQueriesSaved,
+  &stats::loopAnalysisDiffBytes,
+  &stats::loopAnalysisBytesFiltered,
+  &stats::loopAnalysisTimeouts,
+  &stats::loopAnalysisPathsSkipped,
+  &stats::loopAnalysisSummariesApplied,
+};
+static const unsigned numWorkerStats =
+  sizeof(workerStats) / sizeof(workerStats[0]);
+
+/// The change of \p stat in the report of a worker.
+static uint64_t workerStatDelta(const std::vector<uint64_t> &deltas,
+                                const Statistic &stat) {
+  for (unsigned i = 0; i < numWorkerStats; ++i)
+    if (workerStats[i] == &stat) return deltas[i];
+  assert(0 && "not a worker statistic");
+  return 0;
+}
+
+void LoopInProcess::startWorker() {
+  workerStart = profile.rounds.back();
+  workerStartStats.clear();
+  for (unsigned i = 0; i < numWorkerStats; ++i)
+    workerStartStats.push_back(*workerStats[i]);
+}
+
+void LoopInProcess::writeWorkerReport(FILE *report) {
+  retryDeferredDiffs(&changedBytes, &diffContext);
+  fprintf(report, "diff-time %llu\nstats",
+          (unsigned long long)(profile.rounds.back().diffTime -
+                               workerStart.diffTime));
+  for (unsigned i = 0; i < numWorkerStats; ++i)
+    fprintf(report, " %llu",
+            (unsigned long long)(*workerStats[i] - workerStartStats[i]));
+  fprintf(report, "\n");
+  // The memory objects are shared with the main process through fork.
+  for (StateByteMask::const_iterator i = changedBytes.begin(),
+         e = changedBytes.end(); i != e; ++i) {
+    const MemoryObject *mo = i->first;
+    unsigned j = 0;
+    while (j < mo->size) {
+      if (!i->second->get(j)) {
+        ++j;
+        continue;
+      }
+      unsigned begin = j;
+      while (j < mo->size && i->second->get(j)) ++j;
+      fprintf(report, "bytes %p %u %u\n", (const void *)mo, begin, j);
+    }
+  }
+  fprintf(report, "end\n");
+}
+
+bool LoopInProcess::mergeWorkerReport(FILE *report) {
+  unsigned long long diffTime;
+  char tag[8];
+  if (fscanf(report, "diff-time %llu %7s", &diffTime, tag) != 2 ||
+      strcmp(tag, "stats"))
+    return false;
+  std::vector<uint64_t> statDeltas;
+  for (unsigned i = 0; i < numWorkerStats; ++i) {
+    unsigned long long delta;
+    if (fscanf(report, "%llu", &delta) != 1) return false;
+    statDeltas.push_back(delta);
+  }
+
+  std::set<const MemoryObject *> objects;
+  for (MemoryMap::iterator i = restartState->addressSpace.objects.begin(),
+         e = restartState->addressSpace.objects.end(); i != e; ++i)
+    objects.insert(i->first);
+  std::vector<std::pair<const MemoryObject *,
+                        std::pair<unsigned, unsigned> > > runs;
+  for (;;) {
+    if (fscanf(report, "%7s", tag) != 1) return false;
+    if (!strcmp(tag, "end")) break;
+    void *ptr;
+    unsigned begin, end;
+    if (strcmp(tag, "bytes") ||
+        fscanf(report, "%p %u %u", &ptr, &begin, &end) != 3)
+      return false;
+    const MemoryObject *mo = static_cast<const MemoryObject *>(ptr);
+    if (!objects.count(mo) || begin >= end || end > mo->size) return false;
+    runs.push_back(std::make_pair(mo, std::make_pair(begin, end)));
+  }
+
+  for (unsigned i = 0; i < runs.size(); ++i) {
+    const MemoryObject *mo = runs[i].first;
+    BitArray *&bytes = changedBytes[mo];
+    if (!bytes) bytes = new BitArray(mo->size);
+    for (unsigned j = runs[i].second.first; j < runs[i].second.second; ++j) {
+      if (!bytes->get(j)) {
+        bytes->set(j);
+        lastRoundUpdated = true;
+      }
+    }
+  }
+  LoopAnalysisProfile::Round &now = profile.rounds.back();
+  unsigned paths = workerStatDelta(statDeltas, stats::loopAnalysisWorkerPaths);
+  // The handed off path itself finishes in nextRoundState.
+  if (paths > 0) now.paths += paths - 1;
+  now.workerPaths += paths;
+  now.queries += workerStatDelta(statDeltas, stats::loopAnalysisQueries);
+  now.queriesSaved +=
+    workerStatDelta(statDeltas, stats::loopAnalysisQueriesSaved);
+  now.pathsSkipped +=
+    workerStatDelta(statDeltas, stats::loopAnalysisPathsSkipped);
+  now.diffTime += diffTime;
+  for (unsigned i = 0; i < numWorkerStats; ++i)
+    *workerStats[i] += statDeltas[i];
+  return true;
+}
+
 void ExecutionState::dumpConstraints() const {
   const char* digits[10] = {"0", "1", "2", "3", "4", "5", "6", "7", "8", "9"};
   static int cnt = 0;
@@ -84,6 +84,7 @@
 
 
 #include <cassert>
+#include <cstring>
 #include <algorithm>
 #include <iomanip>
 #include <iosfwd>
@@ -93,6 +94,9 @@
 #include <string>
 
 #include <sys/mman.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <unistd.h>
 
 #include <errno.h>
 #include <cxxabi.h>
@@ -312,6 +316,11 @@ namespace {
   MaxMemoryInhibit("max-memory-inhibit",
             cl::desc("Inhibit forking at memory cap (vs. random terminate) (default=on)"),
             cl::init(true));
+
+  cl::opt<unsigned>
+  LoopAnalysisWorkers("loop-analysis-workers",
+                      cl::desc("Explore the paths forked during a loop invariant analysis round in up to this many worker processes (default=0 (off))"),
+                      cl::init(0));
 }
 
 
@@ -350,6 +359,14 @@ Executor::Executor(LLVMContext &ctx, const InterpreterOptions &opts,
       debugInstFile(0), debugLogBuffer(debugBufferString) {
 
   if (coreSolverTimeout) UseForkedCoreSolver = true;
+  // The forked STP and metaSMT solvers share their result memory with
+  // all the processes forked from this one.
+  if (LoopAnalysisWorkers && UseForkedCoreSolver &&
+      CoreSolverToUse != Z3_SOLVER) {
+    klee_warning("--loop-analysis-workers needs --use-forked-solver=false "
+                 "with this solver backend, disabling the workers.");
+    LoopAnalysisWorkers = 0;
+  }
   Solver *coreSolver = klee::createCoreSolver(CoreSolverToUse);
   if (!coreSolver) {
     klee_error("Failed to create core solver\n");
@@ -1613,6 +1630,7 @@ void klee::FillCallInfoOutput(Function* f,
   info->returned = true;
 
   state.recordRetConstraints(info);
+  info->cacheHashes();
 }
 
 void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
@@ -1631,7 +1649,10 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
     }
 
     Function* f = ri->getParent()->getParent();
-    if (!state.callPath.empty() && f == state.callPath.back().f) {
+    // Only read here, not to unshare the last call of a forked state on
+    // every return.
+    const SharedPrefixList<CallInfo> &cp = state.callPath;
+    if (!cp.empty() && f == cp.back().f) {
       CallInfo *info = &state.callPath.back();
       FillCallInfoOutput(f, isVoidReturn, result, state, *this, info);
     }
@@ -2945,8 +2966,16 @@ void Executor::run(ExecutionState &initialState) {
   std::vector<ExecutionState *> newStates(states.begin(), states.end());
   searcher->update(0, newStates, std::vector<ExecutionState *>());
 
-  while (!states.empty() && !haltExecution) {
+  while ((!states.empty() || !loopWorkers.empty()) && !haltExecution) {
+    if (!loopWorkers.empty()) {
+      // Wait for the workers when there is nothing else to explore.
+      bool idle = searcher->empty();
+      if (idle || (stats::instructions % 1000) == 0)
+        collectLoopWorkers(idle);
+      if (idle) continue;
+    }
     ExecutionState &state = searcher->selectState();
+    assert(states.count(&state) && "selected a path handed off to a worker");
     KInstruction *ki = state.pc;
     stepInstruction(state);
 
@@ -2955,15 +2984,150 @@ void Executor::run(ExecutionState &initialState) {
 
     checkMemoryUsage();
 
+    std::vector<ExecutionState *> forked(addedStates);
     updateStates(&state);
+    if (LoopAnalysisWorkers) handOffLoopPaths(forked);
   }
 
+  killLoopWorkers();
+
   delete searcher;
   searcher = 0;
 
   doDumpStates();
 }
 
+void Executor::handOffLoopPaths(const std::vector<ExecutionState *> &forked) {
+  for (std::vector<ExecutionState *>::const_iterator it = forked.begin(),
+         ie = forked.end(); it != ie; ++it) {
+    if (!workerLoop.isNull() || loopWorkers.size() >= LoopAnalysisWorkers)
+      return;
+    ExecutionState *es = *it;
+    if (!states.count(es) || es->loopInProcess.isNull()) continue;
+
+    // The output writer thread is not forked, its locks would stay held
+    // in the worker.
+    interpreterHandler->flushOutput();
+    // Do not let the worker write out the buffers of this process again.
+    llvm::outs().flush();
+    llvm::errs().flush();
+    fflush(NULL);
+    FILE *report = tmpfile();
+    if (!report) {
+      klee_warning("could not create a loop analysis worker report (%s), "
+                   "disabling the workers.", strerror(errno));
+      LoopAnalysisWorkers = 0;
+      return;
+    }
+    pid_t pid = ::fork();
+    if (pid < 0) {
+      klee_warning("could not fork a loop analysis worker (%s), "
+                   "disabling the workers.", strerror(errno));
+      LoopAnalysisWorkers = 0;
+      fclose(report);
+      return;
+    }
+    if (pid == 0) runLoopWorker(*es, report);
+
+    es->loopInProcess->markPathsInWorkers();
+    std::vector<ExecutionState *> handedOff(1, es);
+    searcher->update(nullptr, std::vector<ExecutionState *>(), handedOff);
+    states.erase(es);
+    // Keep the random path searcher from waiting for the worker.
+    processTree->detach(es->ptreeNode);
+    LoopWorker worker = {pid, es, report};
+    loopWorkers.push_back(worker);
+  }
+}
+
+void Executor::runLoopWorker(ExecutionState &state, FILE *report) {
+  // Holding the analysis keeps the paths of the worker from finishing
+  // the round.
+  workerLoop = state.loopInProcess;
+  loopWorkers.clear();
+  seedMap.clear();
+  states.clear();
+  states.insert(&state);
+  // The searcher of the main process is left behind, it still refers to
+  // the paths of the main process.
+  searcher = new DFSSearcher();
+  std::vector<ExecutionState *> initial(1, &state);
+  searcher->update(0, initial, std::vector<ExecutionState *>());
+  workerLoop->startWorker();
+
+  while (!states.empty()) {
+    if (haltExecution) abandonLoopWorker();
+    ExecutionState &current = searcher->selectState();
+    KInstruction *ki = current.pc;
+    stepInstruction(current);
+
+    executeInstruction(current, ki);
+    // A nested analysis would be summarized in this process only.
+    if (!current.loopInProcess.isNull() &&
+        current.loopInProcess.get() != workerLoop.get())
+      abandonLoopWorker();
+
+    updateStates(&current);
+  }
+
+  workerLoop->writeWorkerReport(report);
+  if (fflush(report)) abandonLoopWorker();
+  llvm::outs().flush();
+  llvm::errs().flush();
+  fflush(NULL);
+  _exit(0);
+}
+
+void Executor::abandonLoopWorker() {
+  assert(!workerLoop.isNull() && "not a loop analysis worker");
+  // Drop the buffered output, the main process prints it again.
+  _exit(1);
+}
+
+void Executor::collectLoopWorkers(bool block) {
+  for (unsigned i = 0; i < loopWorkers.size();) {
+    LoopWorker worker = loopWorkers[i];
+    int status;
+    pid_t res = waitpid(worker.pid, &status, block ? 0 : WNOHANG);
+    if (res == 0 || (res < 0 && errno == EINTR)) {
+      ++i;
+      continue;
+    }
+    loopWorkers.erase(loopWorkers.begin() + i);
+    block = false;
+
+    ExecutionState *es = worker.state;
+    rewind(worker.report);
+    bool merged = res == worker.pid && WIFEXITED(status) &&
+                  WEXITSTATUS(status) == 0 &&
+                  es->loopInProcess->mergeWorkerReport(worker.report);
+    fclose(worker.report);
+    processTree->attach(es->ptreeNode);
+    addedStates.push_back(es);
+    if (merged) {
+      terminateState(*es);
+    } else {
+      // The worker gave up, explore the paths here.
+      klee_warning_once(&loopWorkers, "a loop analysis worker stopped early, "
+                        "exploring its paths in the main process.");
+    }
+  }
+  updateStates(0);
+}
+
+void Executor::killLoopWorkers() {
+  for (std::vector<LoopWorker>::iterator it = loopWorkers.begin(),
+         ie = loopWorkers.end(); it != ie; ++it) {
+    kill(it->pid, SIGKILL);
+    waitpid(it->pid, 0, 0);
+    fclose(it->report);
+    // Left for doDumpStates.
+    processTree->attach(it->state->ptreeNode);
+    states.insert(it->state);
+  }
+  loopWorkers.clear();
+}
+
 std::string Executor::getAddressInfo(ExecutionState &state, 
                                      ref<Expr> address) const{
   std::string Str;
@@ -3039,6 +3203,12 @@ void Executor::continueState(ExecutionState &state){
 }
 
 void Executor::terminateState(ExecutionState &state) {
+  if (!workerLoop.isNull()) {
+    // A worker must not write out the paths of the main process.
+    if (state.loopInProcess.isNull()) abandonLoopWorker();
+    ++stats::loopAnalysisWorkerPaths;
+  }
+
   if (replayKTest && replayPosition!=replayKTest->numObjects) {
     klee_warning_once(replayKTest,
                       "replay did not consume all objects in test input.");
@@ -3077,6 +3247,9 @@ void Executor::terminateState(ExecutionState &state) {
 
 void Executor::terminateStateEarly(ExecutionState &state, 
                                    const Twine &message) {
+  if (!workerLoop.isNull()) abandonLoopWorker();
+  // The path may go further in the next loop analysis round.
+  state.recordLoopReadAll();
   if (!OnlyOutputStatesCoveringNew || state.coveredNew ||
       (AlwaysOutputSeeds && seedMap.count(&state)))
     interpreterHandler->processTestCase(state, (message + "\n").str().c_str(),
@@ -3147,6 +3320,7 @@ bool Executor::shouldExitOn(enum TerminateReason termReason) {
 
 void Executor::recordState(ExecutionState &state, const llvm::Twine &messaget,
                            const char *suffix, const llvm::Twine &info) {
+  if (!workerLoop.isNull()) abandonLoopWorker();
   std::string message = messaget.str();
   static std::set<std::pair<Instruction *, std::string>> emittedErrors;
   Instruction *lastInst;
@@ -3182,6 +3356,7 @@ void Executor::terminateStateOnError(ExecutionState &state,
                                      enum TerminateReason termReason,
                                      const char *suffix,
                                      const llvm::Twine &info) {
+  if (!workerLoop.isNull()) abandonLoopWorker();
   std::string message = messaget.str();
   static std::set< std::pair<Instruction*, std::string> > emittedErrors;
   Instruction * lastInst;
@@ -3242,6 +3417,9 @@ void Executor::callExternalFunction(ExecutionState &state,
   // check if specialFunctionHandler wants it
   if (specialFunctionHandler->handle(state, function, target, arguments))
     return;
+
+  // The external function may read any memory.
+  state.recordLoopReadAll();
   
   if (NoExternals && !okExternals.count(function->getName())) {
     klee_warning("Disallowed call to external function: %s\n",
@@ -3428,6 +3606,7 @@ void Executor::executeAlloc(ExecutionState &state,
       bindLocal(target, state, mo->getBaseExpr());
       
       if (reallocFrom) {
+        state.recordLoopReadObject(reallocFrom->getObject());
         unsigned count = std::min(reallocFrom->size, os->size);
         for (unsigned i=0; i<count; i++)
           os->write(i, reallocFrom->read8(i));
@@ -3684,6 +3863,7 @@ void Executor::executeMemoryOperation(ExecutionState &state,
             wos->write(offset, value);
           }
         } else {
+          state.recordLoopRead(mo, offset, bytes);
           ref<Expr> result = os->read(offset, type);
 
           if (interpreterOpts.MakeConcreteSymbolic)
@@ -3736,6 +3916,7 @@ void Executor::executeMemoryOperation(ExecutionState &state,
             wos->write(mo->getOffsetExpr(address), value);
           }
         } else {
+          bound->recordLoopRead(mo, mo->getOffsetExpr(address), bytes);
           ref<Expr> result = os->read(mo->getOffsetExpr(address), type);
           bindLocal(target, *bound, result);
         }
@@ -3988,6 +4169,18 @@ void Executor::runFunctionAsMain(Function *f,
 
   if (statsTracker)
     statsTracker->done();
+  dumpLoopAnalysisStats();
+}
+
+void Executor::dumpLoopAnalysisStats() {
+  if (!loopAnalysisStatsEnabled())
+    return;
+  llvm::raw_ostream *os =
+    interpreterHandler->openOutputFile("loop-analysis.stats");
+  if (os) {
+    writeLoopAnalysisStats(*os);
+    delete os;
+  }
 }
 
 unsigned Executor::getPathStreamID(const ExecutionState &state) {
@@ -4112,6 +4305,34 @@ void Executor::getCoveredLines(const ExecutionState &state,
   res = state.coveredLines;
 }
 
+void Executor::getLiveCallPathPrefixes(const ExecutionState *except,
+                                       std::vector<std::vector<const CallInfo *> >
+                                       &res) {
+  // The leaves of the process tree are all the states, including the ones
+  // not yet added to or removed from the searcher, except for the ones
+  // handed off to loop analysis workers.
+  std::vector<const ExecutionState *> live;
+  std::vector<PTree::Node *> stack;
+  if (processTree->root) stack.push_back(processTree->root);
+  while (!stack.empty()) {
+    PTree::Node *n = stack.back();
+    stack.pop_back();
+    if (n->left) stack.push_back(n->left);
+    if (n->right) stack.push_back(n->right);
+    if (n->data) live.push_back(n->data);
+  }
+  for (std::vector<LoopWorker>::const_iterator it = loopWorkers.begin(),
+         ie = loopWorkers.end(); it != ie; ++it)
+    live.push_back(it->state);
+  for (std::vector<const ExecutionState *>::const_iterator it = live.begin(),
+         ie = live.end(); it != ie; ++it) {
+    if (*it == except) continue;
+    std::vector<const CallInfo *> calls = (*it)->callPath.elements();
+    calls.resize((*it)->getFinalCallPathSize());
+    res.push_back(calls);
+  }
+}
+
 void Executor::doImpliedValueConcretization(ExecutionState &state,
                                             ref<Expr> e,
                                             ref<ConstantExpr> value) {
@@ -4223,6 +4444,7 @@ void Executor::prepareForEarlyExit() {
     // Make sure stats get flushed out
     statsTracker->done();
   }
+  dumpLoopAnalysisStats();
 }
 
 /// Returns the errno location in memory
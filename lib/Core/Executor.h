@@ -29,6 +29,8 @@
 #include <string>
 #include <map>
 #include <set>
+#include <stdio.h>
+#include <sys/types.h>
 
 struct KTest;
 
@@ -207,6 +209,22 @@ private:
   /// step.
   bool haltExecution;  
 
+  /// A path of a loop analysis round handed off to a worker process,
+  /// see --loop-analysis-workers.
+  struct LoopWorker {
+    pid_t pid;
+    /// The handed off state. It is kept out of \ref states until the
+    /// worker finishes.
+    ExecutionState *state;
+    /// Where the worker writes the bytes its paths changed.
+    FILE *report;
+  };
+  std::vector<LoopWorker> loopWorkers;
+
+  /// In a worker process, the loop analysis whose paths it explores.
+  /// Null in the main process.
+  ref<LoopInProcess> workerLoop;
+
   /// Whether implied-value concretization is enabled. Currently
   /// false, it is buggy (it needs to validate its writes).
   bool ivcEnabled;
@@ -476,9 +494,27 @@ private:
   void processTimers(ExecutionState *current,
                      double maxInstTime);
   void checkMemoryUsage();
+
+  /// Hand the given freshly forked loop analysis paths off to worker
+  /// processes, as long as there are free workers.
+  void handOffLoopPaths(const std::vector<ExecutionState *> &forked);
+  /// Explore the paths of \p state within the current round of its loop
+  /// analysis and exit the worker process.
+  void runLoopWorker(ExecutionState &state, FILE *report);
+  /// Exit a worker process without a report: the main process explores
+  /// its paths itself.
+  void abandonLoopWorker();
+  /// Merge the reports of the finished workers. With \p block, wait for
+  /// at least one worker to finish.
+  void collectLoopWorkers(bool block);
+  void killLoopWorkers();
+
   void printDebugInstructions(ExecutionState &state);
   void doDumpStates();
 
+  /// Write the --loop-analysis-stats report to the output directory.
+  void dumpLoopAnalysisStats();
+
 public:
   Executor(llvm::LLVMContext &ctx, const InterpreterOptions &opts,
       InterpreterHandler *ie);
@@ -551,6 +587,10 @@ public:
   virtual void getCoveredLines(const ExecutionState &state,
                                std::map<const std::string*, std::set<unsigned> > &res);
 
+  virtual void getLiveCallPathPrefixes(const ExecutionState *except,
+                                       std::vector<std::vector<const CallInfo *> >
+                                       &res);
+
   Expr::Width getWidthForLLVMType(llvm::Type *type) const;
   size_t getAllocationAlignment(const llvm::Value *allocSite) const;
 
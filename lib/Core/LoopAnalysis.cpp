@@ -0,0 +1,1079 @@
+//===-- LoopAnalysis.cpp --------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/LoopAnalysis.h"
+
+#include "klee/Config/Version.h"
+#include "klee/ExecutionState.h"
+#include "klee/Expr.h"
+#include "klee/Internal/Module/Cell.h"
+#include "klee/Internal/Module/InstructionInfoTable.h"
+#include "klee/Internal/Module/KInstruction.h"
+#include "klee/Internal/Module/KModule.h"
+#include "klee/Internal/Support/ErrorHandling.h"
+#include "klee/Internal/Support/Timer.h"
+#include "klee/Internal/System/Time.h"
+
+#include "CoreStats.h"
+#include "Memory.h"
+#include "TimingSolver.h"
+
+#include "llvm/DebugInfo.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Instruction.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <stdio.h>
+#include <vector>
+
+using namespace llvm;
+using namespace klee;
+
+namespace {
+  enum DiffGranularity {
+    ByteDiff,
+    RangeDiff
+  };
+
+  cl::opt<DiffGranularity>
+  LoopAnalysisDiffGranularity("loop-analysis-diff-granularity",
+                              cl::desc("Granularity of the solver queries "
+                                       "comparing memory between loop "
+                                       "invariant analysis rounds"),
+                              cl::values(clEnumValN(ByteDiff, "byte",
+                                                    "One query per structurally "
+                                                    "different byte"),
+                                         clEnumValN(RangeDiff, "range",
+                                                    "One query per run of "
+                                                    "structurally different "
+                                                    "bytes, split only when the "
+                                                    "run may differ (default)")
+                                         KLEE_LLVM_CL_VAL_END),
+                              cl::init(RangeDiff));
+
+  cl::opt<double>
+  LoopAnalysisDiffTimeout("loop-analysis-diff-timeout",
+                          cl::desc("Timeout in seconds of the solver queries "
+                                   "comparing memory between loop invariant "
+                                   "analysis rounds (default=0.01)"),
+                          cl::init(0.01));
+
+  cl::opt<bool>
+  LoopAnalysisAdaptiveTimeout("loop-analysis-adaptive-timeout",
+                              cl::desc("Raise the diff timeout to a few "
+                                       "times the 95th percentile of the "
+                                       "recent diff query latencies "
+                                       "(default=off)"),
+                              cl::init(false));
+
+  cl::opt<double>
+  LoopAnalysisRetryTimeout("loop-analysis-retry-timeout",
+                           cl::desc("Timeout in seconds to check again, at "
+                                    "the end of the round, the bytes whose "
+                                    "diff query timed out. They are "
+                                    "considered changed if it times out "
+                                    "again, or if 0, unless they are not "
+                                    "allowed to change (default=1)"),
+                           cl::init(1.0));
+
+  cl::opt<bool>
+  LoopAnalysisFieldMasks("loop-analysis-field-masks",
+                         cl::desc("When a byte of a scalar field changes in a "
+                                  "loop, forget the whole field, as given by "
+                                  "the allocated type (default=off)"),
+                         cl::init(false));
+
+  cl::opt<bool>
+  LoopAnalysisStats("loop-analysis-stats",
+                    cl::desc("Write the rounds, paths, mask growth, solver "
+                             "queries and time of each loop invariant "
+                             "analysis to loop-analysis.stats "
+                             "(default=off)"),
+                    cl::init(false));
+
+  cl::opt<std::string>
+  LoopInvariantCache("loop-invariant-cache",
+                     cl::desc("File to load the loop invariants induced by "
+                              "previous runs from, and to store the newly "
+                              "induced ones to (default=off)"),
+                     cl::init(""));
+}
+
+std::string __attribute__((weak)) numToStr(long long n) {
+  std::stringstream ss;
+  ss << n;
+  return ss.str();
+}
+
+void LoopPathReads::record(const MemoryObject *mo,
+                           unsigned offset, unsigned size) {
+  std::vector<bool> &read = bytes[mo];
+  if (read.empty()) read.resize(mo->size, false);
+  for (unsigned j = offset; j < offset + size && j < mo->size; ++j)
+    read[j] = true;
+}
+
+void LoopPathReads::recordObject(const MemoryObject *mo) {
+  record(mo, 0, mo->size);
+}
+
+bool LoopPathReads::intersects(const StateByteMask &mask) const {
+  if (all) return true;
+  for (std::map<const MemoryObject *, std::vector<bool> >::const_iterator
+         i = bytes.begin(), e = bytes.end(); i != e; ++i) {
+    StateByteMask::const_iterator m = mask.find(i->first);
+    if (m == mask.end()) continue;
+    for (unsigned j = 0; j < i->second.size(); ++j) {
+      if (i->second[j] && m->second->get(j)) return true;
+    }
+  }
+  return false;
+}
+
+namespace {
+/// A byte that differs structurally between the reference and the
+/// current memory, and thus must be checked with the solver.
+struct ByteDiffCandidate {
+  unsigned offset;
+  ref<Expr> refVal;
+  ref<Expr> val;
+};
+
+/// The object being compared by updateDiffMask, and whether its bytes
+/// are allowed to change in the loop.
+struct ObjectDiff {
+  BitArray *bytes;
+  const MemoryObject *obj;
+  const ObjectState *refOs;
+  const ObjectState *os;
+  /// The object is not declared with klee_possibly_havoc.
+  bool undeclaredHavoc;
+  /// The name given to klee_never_havoc, if any.
+  std::string neverHavoc;
+};
+}
+
+/// The number of recent query latencies the adaptive timeout looks at.
+static const unsigned LatencyWindow = 128;
+
+/// The timeout for the diff queries: the --loop-analysis-diff-timeout, or
+/// with --loop-analysis-adaptive-timeout a few times the 95th percentile of
+/// the recent query latencies, if that is larger.
+static double diffTimeout(const DiffMaskContext *ctx) {
+  double timeout = LoopAnalysisDiffTimeout;
+  if (!LoopAnalysisAdaptiveTimeout || !ctx || ctx->latencies.size() < 16)
+    return timeout;
+  std::vector<double> sorted(ctx->latencies);
+  std::vector<double>::iterator p95 = sorted.begin() + sorted.size()*95/100;
+  std::nth_element(sorted.begin(), p95, sorted.end());
+  double adaptive = 4 * *p95;
+  if (LoopAnalysisRetryTimeout > timeout &&
+      adaptive > LoopAnalysisRetryTimeout)
+    adaptive = LoopAnalysisRetryTimeout;
+  return std::max(timeout, adaptive);
+}
+
+/// Ask the solver whether \a eq may be false in \a state, within the
+/// \a timeout. The latency of the answered queries is recorded in the
+/// \a ctx, if given. Returns false if the solver failed to give an answer.
+static bool mayBeFalseWithTimeout(const ExecutionState &state,
+                                  TimingSolver *solver,
+                                  ref<Expr> eq,
+                                  double timeout,
+                                  DiffMaskContext *ctx,
+                                  bool &mayDiffer) {
+  ++stats::loopAnalysisQueries;
+  solver->setTimeout(timeout);
+  mayDiffer = true;
+  WallTimer timer;
+  bool solverRes = solver->mayBeFalse(state, eq, /*&*/mayDiffer);
+  solver->setTimeout(0);
+  if (!solverRes) {
+    ++stats::loopAnalysisTimeouts;
+  } else if (ctx) {
+    double latency = timer.check() / 1000000.;
+    if (ctx->latencies.size() < LatencyWindow) {
+      ctx->latencies.push_back(latency);
+    } else {
+      ctx->latencies[ctx->nextLatency] = latency;
+      ctx->nextLatency = (ctx->nextLatency + 1) % LatencyWindow;
+    }
+  }
+  return solverRes;
+}
+
+/// Record that the byte \a j of \a obj changed its value between loop
+/// iterations, and check that it was allowed to do so.
+static void markByteChanged(BitArray *bytes,
+                            const MemoryObject *obj,
+                            const ObjectState *refOs,
+                            const ObjectState *os,
+                            unsigned j,
+                            ref<Expr> refVal,
+                            ref<Expr> val,
+                            bool undeclaredHavoc,
+                            const std::string &neverHavoc) {
+  bytes->set(j);
+
+#if 0
+  fprintf(stderr, "%p Obj size: %d vs. %d\n", obj, refOs->size, os->size);
+  fflush(stderr);
+  fprintf(stderr, "%d byte before: ", j);
+  fflush(stderr);
+  refVal->dump();
+  fprintf(stderr, "%d byte after: ", j);
+  fflush(stderr);
+  val->dump();
+#endif//0
+
+  if (undeclaredHavoc) {
+    fprintf(stderr, "Obj size: %d vs. %d\n", refOs->size, os->size);
+    fflush(stderr);
+    fprintf(stderr, "%d byte before: ", j);
+    fflush(stderr);
+    refVal->dump();
+    fprintf(stderr, "%d byte after: ", j);
+    fflush(stderr);
+    val->dump();
+    fprintf(stderr, "full value before: ");
+    if (refOs->size < 100) {
+      refOs->read(0, refOs->size*8, true)->dump();
+    } else {
+      fprintf(stderr, "too long\n");
+    }
+    fprintf(stderr, "full value after: ");
+    if (os->size < 100 ) {
+      os->read(0, os->size*8, true)->dump();
+    } else {
+      fprintf(stderr, "too long\n");
+    }
+    fprintf(stderr, "Type: ");
+    fflush(stderr);
+    obj->allocSite->getType()->dump();
+    fprintf(stderr, "\n");
+    std::string metadata;
+    if (isa<llvm::Instruction>(obj->allocSite)) {
+      const llvm::Instruction *inst = dyn_cast<llvm::Instruction>(obj->allocSite);
+      if (llvm::MDNode *node = inst->getMetadata("dbg")) {
+        llvm::DILocation loc(node);
+        metadata = loc.getDirectory().str() + "/" +
+          loc.getFilename().str() + ":" +
+          numToStr(loc.getLineNumber());
+      } else {
+        const llvm::Function* fun = inst->getParent()->getParent();
+        metadata = "in function: " + fun->getName().str();
+      }
+    } else {
+      metadata = "(not an instruciton)";
+    }
+    klee_error("Unexpected memory location changed its value during invariant analysis:\n"
+               "  name: %s\n  location: %s\n"
+               "  local: %s\n  global: %s\n"
+               "  fixed: %s\n  size: %u\n"
+               "  address: 0x%lx\n  metadata: %s",
+               obj->name.c_str(),
+               obj->allocSite->getName().str().c_str(),
+               obj->isLocal ? "true" : "false",
+               obj->isGlobal ? "true" : "false",
+               obj->isFixed ? "true" : "false",
+               obj->size,
+               obj->address,
+               metadata.c_str());
+  }
+  if (!neverHavoc.empty()) {
+    fprintf(stderr, "Obj size: %d vs. %d\n", refOs->size, os->size);
+    fflush(stderr);
+    fprintf(stderr, "%d byte before: ", j);
+    fflush(stderr);
+    refVal->dump();
+    fprintf(stderr, "%d byte after: ", j);
+    fflush(stderr);
+    val->dump();
+    fprintf(stderr, "Type: ");
+    fflush(stderr);
+    obj->allocSite->getType()->dump();
+    fprintf(stderr, "\n");
+    std::string metadata;
+    if (isa<llvm::Instruction>(obj->allocSite)) {
+      const llvm::Instruction *inst = dyn_cast<llvm::Instruction>(obj->allocSite);
+      if (llvm::MDNode *node = inst->getMetadata("dbg")) {
+        llvm::DILocation loc(node);
+        metadata = loc.getDirectory().str() + "/" +
+          loc.getFilename().str() + ":" +
+          numToStr(loc.getLineNumber());
+      } else {
+        metadata = "(unknown)";
+      }
+    } else {
+      metadata = "(not an instruciton)";
+    }
+    klee_error("Guaranteed invariant (never-havoc %s) changed during invariant analysis:\n"
+               "  name: %s\n  location: %s\n"
+               "  local: %s\n  global: %s\n"
+               "  fixed: %s\n  size: %u\n"
+               "  address: 0x%lx\n  metadata: %s",
+               neverHavoc.c_str(),
+               obj->name.c_str(),
+               obj->allocSite->getName().str().c_str(),
+               obj->isLocal ? "true" : "false",
+               obj->isGlobal ? "true" : "false",
+               obj->isFixed ? "true" : "false",
+               obj->size,
+               obj->address,
+               metadata.c_str());
+  }
+}
+
+/// Record that the solver could not tell whether the byte \a j of \a obj
+/// changed. A havoc location is assumed to change; for the other ones an
+/// unproven change is no reason to stop, so they are assumed unchanged
+/// with a warning. Returns true if the byte was marked.
+static bool markByteTimedOut(BitArray *bytes,
+                             const MemoryObject *obj,
+                             const ObjectState *refOs,
+                             const ObjectState *os,
+                             unsigned j,
+                             ref<Expr> refVal,
+                             ref<Expr> val,
+                             bool undeclaredHavoc,
+                             const std::string &neverHavoc) {
+  if (!undeclaredHavoc && neverHavoc.empty()) {
+    markByteChanged(bytes, obj, refOs, os, j, refVal, val,
+                    undeclaredHavoc, neverHavoc);
+    return true;
+  }
+  klee_warning_once(obj, "could not prove that the %s location %s is "
+                    "unchanged in the loop, assuming it is",
+                    neverHavoc.empty() ? "undeclared" : "never-havoc",
+                    neverHavoc.empty() ? obj->name.c_str()
+                                       : neverHavoc.c_str());
+  return false;
+}
+
+/// Check the candidates [begin, end) and mark the bytes that may differ.
+/// A run of several bytes is first checked with a single query; it is
+/// split in halves only if that query can not prove all the bytes equal.
+/// A single byte is checked exactly as in the per-byte mode, so the
+/// resulting mask does not depend on the granularity. A single byte whose
+/// query times out is deferred to retryDeferredDiffs if there is a \a ctx,
+/// and passed to markByteTimedOut otherwise.
+static bool diffCandidates(const std::vector<ByteDiffCandidate> &candidates,
+                           unsigned begin, unsigned end,
+                           const ObjectDiff &diff,
+                           const ExecutionState &state,
+                           TimingSolver *solver,
+                           double timeout,
+                           DiffMaskContext *ctx) {
+  assert(begin < end);
+  if (end - begin == 1) {
+    const ByteDiffCandidate &c = candidates[begin];
+    bool mayDiffer = true;
+    bool solverRes = mayBeFalseWithTimeout(state, solver,
+                                           EqExpr::create(c.refVal, c.val),
+                                           timeout, ctx, mayDiffer);
+    if (!solverRes && ctx) {
+      DeferredByteDiff deferred;
+      deferred.obj = diff.obj;
+      deferred.offset = c.offset;
+      deferred.refVal = c.refVal;
+      deferred.val = c.val;
+      deferred.constraints.assign(state.constraints.begin(),
+                                  state.constraints.end());
+      deferred.refOs = const_cast<ObjectState *>(diff.refOs);
+      deferred.os = const_cast<ObjectState *>(diff.os);
+      deferred.undeclaredHavoc = diff.undeclaredHavoc;
+      deferred.neverHavoc = diff.neverHavoc;
+      ctx->deferred.push_back(deferred);
+      ctx->solver = solver;
+      return false;
+    }
+    if (!solverRes)
+      return markByteTimedOut(diff.bytes, diff.obj, diff.refOs, diff.os,
+                              c.offset, c.refVal, c.val,
+                              diff.undeclaredHavoc, diff.neverHavoc);
+    if (mayDiffer) {
+      markByteChanged(diff.bytes, diff.obj, diff.refOs, diff.os, c.offset,
+                      c.refVal, c.val, diff.undeclaredHavoc, diff.neverHavoc);
+      return true;
+    }
+    return false;
+  }
+
+  ref<Expr> allEqual = EqExpr::create(candidates[begin].refVal,
+                                      candidates[begin].val);
+  for (unsigned k = begin + 1; k < end; ++k) {
+    allEqual = AndExpr::create(allEqual,
+                               EqExpr::create(candidates[k].refVal,
+                                              candidates[k].val));
+  }
+  bool mayDiffer = true;
+  bool solverRes = mayBeFalseWithTimeout(state, solver, allEqual,
+                                         timeout, ctx, mayDiffer);
+  if (solverRes && !mayDiffer) return false;
+
+  unsigned mid = begin + (end - begin)/2;
+  bool updatedLow = diffCandidates(candidates, begin, mid, diff,
+                                   state, solver, timeout, ctx);
+  bool updatedHigh = diffCandidates(candidates, mid, end, diff,
+                                    state, solver, timeout, ctx);
+  return updatedLow || updatedHigh;
+}
+
+/// Find the scalar field of \a type that contains the byte at \a offset,
+/// descending into structs and arrays. Padding bytes are fields of their
+/// own. Returns the field as [*begin, *end) relative to the start of
+/// \a type.
+static void findScalarField(Type *type, const DataLayout &layout,
+                            uint64_t offset,
+                            uint64_t *begin, uint64_t *end) {
+  if (StructType *st = dyn_cast<StructType>(type)) {
+    const StructLayout *sl = layout.getStructLayout(st);
+    unsigned idx = sl->getElementContainingOffset(offset);
+    uint64_t elemOffset = sl->getElementOffset(idx);
+    Type *elemType = st->getElementType(idx);
+    if (offset - elemOffset < layout.getTypeStoreSize(elemType)) {
+      findScalarField(elemType, layout, offset - elemOffset, begin, end);
+      *begin += elemOffset;
+      *end += elemOffset;
+      return;
+    }
+  } else if (ArrayType *at = dyn_cast<ArrayType>(type)) {
+    Type *elemType = at->getElementType();
+    uint64_t elemSize = layout.getTypeAllocSize(elemType);
+    if (elemSize != 0) {
+      uint64_t elemOffset = offset - offset % elemSize;
+      if (offset - elemOffset < layout.getTypeStoreSize(elemType)) {
+        findScalarField(elemType, layout, offset - elemOffset, begin, end);
+        *begin += elemOffset;
+        *end += elemOffset;
+        return;
+      }
+    }
+  } else if (type->isSized() && offset < layout.getTypeStoreSize(type)) {
+    *begin = 0;
+    *end = layout.getTypeStoreSize(type);
+    return;
+  }
+  *begin = offset;
+  *end = offset + 1;
+}
+
+/// Extend the changed bytes of \a obj to the whole scalar fields they
+/// belong to. Objects whose type is unknown, such as the heap ones, are
+/// left as they are.
+static void widenToFields(BitArray *bytes, const MemoryObject *obj) {
+  const Value *allocSite = obj->allocSite;
+  if (!allocSite) return;
+  Type *type = 0;
+  const Module *module = 0;
+  if (const AllocaInst *ai = dyn_cast<AllocaInst>(allocSite)) {
+    type = ai->getAllocatedType();
+    module = ai->getParent()->getParent()->getParent();
+  } else if (const GlobalVariable *gv = dyn_cast<GlobalVariable>(allocSite)) {
+    type = gv->getType()->getElementType();
+    module = gv->getParent();
+  }
+  if (!type || !module || !type->isSized()) return;
+
+  DataLayout layout(module);
+  uint64_t typeSize = layout.getTypeAllocSize(type);
+  if (typeSize == 0) return;
+  for (unsigned j = 0; j < obj->size; ++j) {
+    if (!bytes->get(j)) continue;
+    // An alloca of several elements repeats the type.
+    uint64_t base = j - j % typeSize;
+    uint64_t begin, end;
+    findScalarField(type, layout, j - base, &begin, &end);
+    for (uint64_t k = base + begin; k < base + end && k < obj->size; ++k)
+      bytes->set(k);
+    if (base + end > j + 1) j = base + end - 1;
+  }
+}
+
+/// Rewrite \a e so that equal values read through different update lists
+/// look the same: a read with a constant index skips the writes that can
+/// not alias it, and is replaced by the value of a write that must.
+static ref<Expr> normalizeReads(ref<Expr> e,
+                                ExprHashMap<ref<Expr> > &normalized) {
+  if (isa<klee::ConstantExpr>(e)) return e;
+  ExprHashMap<ref<Expr> >::iterator it = normalized.find(e);
+  if (it != normalized.end()) return it->second;
+
+  ref<Expr> result;
+  if (ReadExpr *re = dyn_cast<ReadExpr>(e)) {
+    ref<Expr> index = normalizeReads(re->index, normalized);
+    const UpdateNode *un = re->updates.head;
+    if (isa<klee::ConstantExpr>(index)) {
+      for (; un; un = un->next) {
+        ref<Expr> alias = EqExpr::create(index, un->index);
+        if (!isa<klee::ConstantExpr>(alias) || alias->isTrue()) break;
+      }
+    }
+    if (un && EqExpr::create(index, un->index)->isTrue()) {
+      result = normalizeReads(un->value, normalized);
+    } else {
+      result = ReadExpr::create(UpdateList(re->updates.root, un), index);
+    }
+  } else {
+    ref<Expr> kids[8];
+    unsigned numKids = e->getNumKids();
+    assert(numKids <= 8 && "Unexpected number of kids");
+    bool changed = false;
+    for (unsigned i = 0; i < numKids; ++i) {
+      kids[i] = normalizeReads(e->getKid(i), normalized);
+      if (kids[i] != e->getKid(i)) changed = true;
+    }
+    result = changed ? e->rebuild(kids) : e;
+  }
+  normalized.insert(std::make_pair(e, result));
+  return result;
+}
+
+/// Check without the solver whether the byte values \a refVal and \a val
+/// are equal in \a state: first structurally after normalizeReads, which
+/// is remembered in the \a cache, then after simplifying both with the
+/// path constraints.
+static bool provablyEqual(ref<Expr> refVal, ref<Expr> val,
+                          const ExecutionState &state,
+                          ByteDiffCache *cache,
+                          ExprHashMap<ref<Expr> > &normalized) {
+  ref<Expr> key = EqExpr::alloc(refVal, val);
+  ByteDiffCache::iterator it;
+  bool equal;
+  if (cache && (it = cache->find(key)) != cache->end()) {
+    equal = it->second;
+  } else {
+    refVal = normalizeReads(refVal, normalized);
+    val = normalizeReads(val, normalized);
+    equal = (refVal == val);
+    if (cache) cache->insert(std::make_pair(key, equal));
+  }
+  if (equal) return true;
+
+  ref<Expr> eq = state.constraints.simplifyExpr(EqExpr::create(refVal, val));
+  return eq->isTrue();
+}
+
+bool klee::updateDiffMask(StateByteMask* mask,
+                          const AddressSpace& refValues,
+                          const ExecutionState& state,
+                          TimingSolver* solver,
+                          DiffMaskContext *ctx) {
+  bool updated = false;
+  ByteDiffCache *cache = ctx ? &ctx->cache : 0;
+  double timeout = diffTimeout(ctx);
+  ExprHashMap<ref<Expr> > normalized;
+  for (MemoryMap::iterator
+         i = refValues.objects.begin(),
+         e = refValues.objects.end();
+       i != e; ++i) {
+    const MemoryObject *obj = i->first;
+    const ObjectState *refOs = i->second;
+    const ObjectState *os = state.addressSpace.findObject(obj);
+    if (refOs == os) continue;
+    if (refOs->isAccessible() != os->isAccessible()) {
+      std::string inacc_msg;
+      if (refOs->isAccessible()) {
+        inacc_msg = "cand " + os->inaccessible_message;
+      } else {
+        inacc_msg = "ref " + refOs->inaccessible_message;
+      }
+      printf("No support for accessibility alternation "
+             "between loop iterations. Inaccessibility reason: %s\n",
+             inacc_msg.c_str());
+      exit(1);
+    }
+    assert(refOs->isAccessible() == os->isAccessible() &&
+           "No support for accessibility alteration "
+           "between loop iterations.");
+    //printf("inserting %p\n", obj);
+    std::pair<std::map<const MemoryObject *, BitArray *>::iterator, bool>
+      insRez = mask->insert
+      (std::pair<const MemoryObject *, BitArray *>(obj, 0));
+
+
+    if (insRez.second) insRez.first->second =
+                         new BitArray(obj->size);
+    BitArray *bytes = insRez.first->second;
+    assert(bytes != 0);
+
+    // Collect the bytes that were not diferent on the previous rounds,
+    // but differ structuraly now. It is time to make sure they can be
+    // really different.
+    std::vector<ByteDiffCandidate> candidates;
+    unsigned size = obj->size;
+    for (unsigned j = 0; j < size; ++j) {
+      if (bytes->get(j)) continue;
+      ref<Expr> refVal = refOs->read8(j, true);
+      ref<Expr> val = os->read8(j, true);
+      if (0 != refVal->compare(*val)) {
+        if (provablyEqual(refVal, val, state, cache, normalized)) {
+          ++stats::loopAnalysisBytesFiltered;
+          continue;
+        }
+        ByteDiffCandidate c = {j, refVal, val};
+        candidates.push_back(c);
+      }
+    }
+    if (candidates.empty()) continue;
+
+    stats::loopAnalysisDiffBytes += candidates.size();
+    uint64_t queriesBefore = stats::loopAnalysisQueries;
+
+    ObjectDiff diff;
+    diff.bytes = bytes;
+    diff.obj = obj;
+    diff.refOs = refOs;
+    diff.os = os;
+    diff.undeclaredHavoc = state.havocs.find(obj) == state.havocs.end() &&
+                           !state.condoneUndeclaredHavocs;
+    std::map<const MemoryObject *, std::string>::const_iterator never =
+      state.noHavocs.find(obj);
+    if (never != state.noHavocs.end()) diff.neverHavoc = never->second;
+
+    bool objectUpdated = false;
+    unsigned runBegin = 0;
+    while (runBegin < candidates.size()) {
+      unsigned runEnd = runBegin + 1;
+      if (LoopAnalysisDiffGranularity == RangeDiff) {
+        while (runEnd < candidates.size() &&
+               candidates[runEnd].offset == candidates[runEnd - 1].offset + 1)
+          ++runEnd;
+      }
+      if (diffCandidates(candidates, runBegin, runEnd, diff,
+                         state, solver, timeout, ctx))
+        objectUpdated = true;
+      runBegin = runEnd;
+    }
+    if (objectUpdated) {
+      updated = true;
+      if (LoopAnalysisFieldMasks) widenToFields(bytes, obj);
+    }
+
+    uint64_t queriesIssued = stats::loopAnalysisQueries - queriesBefore;
+    if (queriesIssued < candidates.size())
+      stats::loopAnalysisQueriesSaved += candidates.size() - queriesIssued;
+  }
+  return updated;
+}
+
+bool LoopEntryState::appliesTo(const ExecutionState &entryState,
+                               const llvm::Loop *loop,
+                               KFunction *kf) const {
+  // More constraints can only make fewer bytes differ.
+  ExprHashSet entryConstraints(entryState.constraints.begin(),
+                               entryState.constraints.end());
+  for (std::vector<ref<Expr> >::const_iterator i = constraints.begin(),
+         e = constraints.end(); i != e; ++i) {
+    if (!entryConstraints.count(*i)) return false;
+  }
+
+  // The registers defined outside of the loop keep their values in it.
+  const StackFrame &sf = entryState.stack.back();
+  if (sf.kf != kf || locals.size() != kf->numRegisters) return false;
+  std::vector<bool> definedInLoop(kf->numRegisters, false);
+  for (llvm::Loop::block_iterator b = loop->block_begin(),
+         be = loop->block_end(); b != be; ++b) {
+    unsigned first = kf->basicBlockEntry[*b];
+    for (unsigned k = first; k < first + (*b)->size(); ++k)
+      definedInLoop[kf->instructions[k]->dest] = true;
+  }
+  for (unsigned r = 0; r < kf->numRegisters; ++r) {
+    if (definedInLoop[r]) continue;
+    const ref<Expr> &value = sf.locals[r].value;
+    if (value.isNull() != locals[r].isNull()) return false;
+    if (!value.isNull() && value != locals[r]) return false;
+  }
+
+  // The memory outside of the mask is the same.
+  for (MemoryMap::iterator i = addressSpace.objects.begin(),
+         e = addressSpace.objects.end(); i != e; ++i) {
+    const MemoryObject *obj = i->first;
+    const ObjectState *refOs = i->second;
+    const ObjectState *os = entryState.addressSpace.findObject(obj);
+    if (!os) return false;
+    if (os == refOs) continue;
+    if (os->isAccessible() != refOs->isAccessible()) return false;
+    StateByteMask::const_iterator mask = forgetMask.find(obj);
+    for (unsigned j = 0; j < obj->size; ++j) {
+      if (mask != forgetMask.end() && mask->second->get(j)) continue;
+      if (refOs->read8(j, true) != os->read8(j, true)) return false;
+    }
+  }
+  return true;
+}
+
+bool klee::retryDeferredDiffs(StateByteMask *mask, DiffMaskContext *ctx) {
+  bool updated = false;
+  for (std::vector<DeferredByteDiff>::const_iterator
+         i = ctx->deferred.begin(), e = ctx->deferred.end(); i != e; ++i) {
+    BitArray *&bytes = (*mask)[i->obj];
+    if (!bytes) bytes = new BitArray(i->obj->size);
+    if (bytes->get(i->offset)) continue;
+
+    bool mayDiffer = true;
+    bool solverRes = false;
+    if (LoopAnalysisRetryTimeout > 0) {
+      ExecutionState queryState(i->constraints);
+      solverRes = mayBeFalseWithTimeout(queryState, ctx->solver,
+                                        EqExpr::create(i->refVal, i->val),
+                                        LoopAnalysisRetryTimeout, ctx,
+                                        mayDiffer);
+    }
+    if (!solverRes) {
+      if (!markByteTimedOut(bytes, i->obj, i->refOs, i->os, i->offset,
+                            i->refVal, i->val, i->undeclaredHavoc,
+                            i->neverHavoc))
+        continue;
+    } else if (mayDiffer) {
+      markByteChanged(bytes, i->obj, i->refOs, i->os, i->offset,
+                      i->refVal, i->val, i->undeclaredHavoc, i->neverHavoc);
+    } else {
+      continue;
+    }
+    LOG_LA("Deferred byte " << i->offset << " of " << i->obj->name
+           << " may differ");
+    if (LoopAnalysisFieldMasks) widenToFields(bytes, i->obj);
+    updated = true;
+  }
+  ctx->deferred.clear();
+  return updated;
+}
+
+namespace {
+/// The bytes of a single named havoc location that may change in a loop.
+struct CachedHavocMask {
+  unsigned size;
+  std::vector<std::pair<unsigned, unsigned> > ranges;
+};
+
+/// A converged forget mask, keyed by havoc names instead of the
+/// MemoryObjects, which differ from run to run.
+typedef std::map<std::string, CachedHavocMask> CachedInvariant;
+
+/// The entries of the --loop-invariant-cache file, loaded at the first
+/// lookup and rewritten on each store.
+std::map<std::string, CachedInvariant> cachedInvariants;
+bool cachedInvariantsLoaded = false;
+}
+
+static uint64_t hashString(uint64_t h, const std::string &s) {
+  // FNV-1a, to keep the hash stable across builds and platforms.
+  for (std::string::const_iterator i = s.begin(), e = s.end(); i != e; ++i) {
+    h ^= (unsigned char)*i;
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+/// The function and the source location of the loop header.
+static std::string loopLocation(const llvm::Loop *loop, KFunction *kf) {
+  const llvm::BasicBlock *header = loop->getHeader();
+  unsigned first = kf->basicBlockEntry[const_cast<llvm::BasicBlock*>(header)];
+  std::string location = "?:0";
+  for (unsigned k = first; k < first + header->size(); ++k) {
+    const InstructionInfo &ii = *kf->instructions[k]->info;
+    if (ii.line != 0) {
+      location = ii.file + ":" + numToStr(ii.line);
+      break;
+    }
+  }
+  return kf->function->getName().str() + " " + location;
+}
+
+/// Hash the instructions of the loop body, ignoring the register numbering,
+/// so that changes elsewhere in the function do not change the hash.
+static uint64_t hashLoopBody(const llvm::Loop *loop) {
+  uint64_t h = 14695981039346656037ULL;
+  for (llvm::Loop::block_iterator bi = loop->block_begin(),
+         be = loop->block_end(); bi != be; ++bi) {
+    for (llvm::BasicBlock::const_iterator ii = (*bi)->begin(),
+           ie = (*bi)->end(); ii != ie; ++ii) {
+      h = hashString(h, ii->getOpcodeName());
+      std::string type;
+      llvm::raw_string_ostream typeOs(type);
+      ii->getType()->print(typeOs);
+      h = hashString(h, typeOs.str());
+      for (unsigned k = 0; k < ii->getNumOperands(); ++k) {
+        const llvm::Value *op = ii->getOperand(k);
+        if (const llvm::GlobalValue *gv = dyn_cast<llvm::GlobalValue>(op)) {
+          h = hashString(h, gv->getName().str());
+        } else if (const llvm::ConstantInt *ci =
+                   dyn_cast<llvm::ConstantInt>(op)) {
+          h = hashString(h, ci->getValue().toString(16, false));
+        } else {
+          h = hashString(h, "%");
+        }
+      }
+    }
+  }
+  return h;
+}
+
+/// The stable identity of the loop: function name, the source location
+/// of the loop header and the hash of the loop body.
+static std::string loopCacheKey(const llvm::Loop *loop, KFunction *kf) {
+  std::stringstream key;
+  key << loopLocation(loop, kf) << " " << std::hex << hashLoopBody(loop);
+  return key.str();
+}
+
+/// Map the havoc names of the \a state to their memory objects. A name
+/// given to several klee_possibly_havoc calls is made unique with a
+/// suffix ("x", "x_1", ...) in the order of the calls, which need not be
+/// the same in another run, so such names go to \a ambiguous instead.
+static void mapHavocNames(const ExecutionState &state,
+                          std::map<std::string, const MemoryObject *> *byName,
+                          std::set<std::string> *ambiguous) {
+  for (std::map<const MemoryObject *, HavocInfo>::const_iterator
+         i = state.havocs.begin(), e = state.havocs.end(); i != e; ++i)
+    (*byName)[i->second.name] = i->first;
+  for (std::map<const MemoryObject *, HavocInfo>::const_iterator
+         i = state.havocs.begin(), e = state.havocs.end(); i != e; ++i) {
+    const std::string &name = i->second.name;
+    size_t suffix = name.find_last_of('_');
+    if (suffix == std::string::npos || suffix + 1 == name.size() ||
+        name.find_first_not_of("0123456789", suffix + 1) != std::string::npos)
+      continue;
+    std::string base = name.substr(0, suffix);
+    if (!byName->count(base)) continue;
+    ambiguous->insert(base);
+    ambiguous->insert(name);
+  }
+  for (std::set<std::string>::const_iterator i = ambiguous->begin(),
+         e = ambiguous->end(); i != e; ++i)
+    byName->erase(*i);
+}
+
+/// The cache file format is line based:
+///   loop <function> <file>:<line> <body hash>
+///   havoc <size> <lo>-<hi> ... : <havoc name>
+///   end
+static void loadCachedInvariants() {
+  cachedInvariantsLoaded = true;
+  std::ifstream in(LoopInvariantCache.c_str());
+  if (!in.good()) return;
+  std::string line;
+  std::string key;
+  CachedInvariant current;
+  bool inLoop = false;
+  while (std::getline(in, line)) {
+    if (line.compare(0, 5, "loop ") == 0) {
+      key = line.substr(5);
+      current.clear();
+      inLoop = true;
+    } else if (line == "end" && inLoop) {
+      cachedInvariants[key] = current;
+      inLoop = false;
+    } else if (line.compare(0, 6, "havoc ") == 0 && inLoop) {
+      size_t colon = line.find(" : ");
+      if (colon == std::string::npos) {
+        klee_warning("malformed loop invariant cache line: %s", line.c_str());
+        inLoop = false;
+        continue;
+      }
+      std::stringstream ranges(line.substr(6, colon - 6));
+      CachedHavocMask mask;
+      ranges >> mask.size;
+      unsigned lo, hi;
+      char dash;
+      while (ranges >> lo >> dash >> hi) {
+        mask.ranges.push_back(std::make_pair(lo, hi));
+      }
+      current[line.substr(colon + 3)] = mask;
+    } else if (!line.empty()) {
+      klee_warning("malformed loop invariant cache line: %s", line.c_str());
+      inLoop = false;
+    }
+  }
+}
+
+static void saveCachedInvariants() {
+  std::string tmpName = LoopInvariantCache + ".tmp";
+  {
+    std::ofstream out(tmpName.c_str());
+    if (!out.good()) {
+      klee_warning("can not write the loop invariant cache %s",
+                   tmpName.c_str());
+      return;
+    }
+    for (std::map<std::string, CachedInvariant>::const_iterator
+           i = cachedInvariants.begin(), e = cachedInvariants.end();
+         i != e; ++i) {
+      out << "loop " << i->first << "\n";
+      for (CachedInvariant::const_iterator hi = i->second.begin(),
+             he = i->second.end(); hi != he; ++hi) {
+        out << "havoc " << hi->second.size;
+        for (unsigned k = 0; k < hi->second.ranges.size(); ++k) {
+          out << " " << hi->second.ranges[k].first
+              << "-" << hi->second.ranges[k].second;
+        }
+        out << " : " << hi->first << "\n";
+      }
+      out << "end\n";
+    }
+  }
+  if (rename(tmpName.c_str(), LoopInvariantCache.c_str()) != 0) {
+    klee_warning("can not write the loop invariant cache %s",
+                 LoopInvariantCache.c_str());
+  }
+}
+
+bool klee::lookupCachedInvariant(const llvm::Loop *loop, KFunction *kf,
+                                 const ExecutionState &headerState,
+                                 StateByteMask *mask) {
+  if (LoopInvariantCache.empty()) return false;
+  if (!cachedInvariantsLoaded) loadCachedInvariants();
+
+  std::map<std::string, CachedInvariant>::const_iterator entry =
+    cachedInvariants.find(loopCacheKey(loop, kf));
+  if (entry == cachedInvariants.end()) return false;
+
+  std::map<std::string, const MemoryObject *> byName;
+  std::set<std::string> ambiguous;
+  mapHavocNames(headerState, &byName, &ambiguous);
+
+  // Resolve all the names first, so that a stale entry leaves the
+  // mask untouched.
+  std::vector<std::pair<const MemoryObject *, const CachedHavocMask *> >
+    resolved;
+  for (CachedInvariant::const_iterator i = entry->second.begin(),
+         e = entry->second.end(); i != e; ++i) {
+    std::map<std::string, const MemoryObject *>::const_iterator named =
+      byName.find(i->first);
+    if (named == byName.end() || named->second->size != i->second.size) {
+      LOG_LA("Stale or ambiguous loop invariant cache entry for " << i->first);
+      return false;
+    }
+    resolved.push_back(std::make_pair(named->second, &i->second));
+  }
+
+  for (unsigned k = 0; k < resolved.size(); ++k) {
+    const MemoryObject *mo = resolved[k].first;
+    const CachedHavocMask *cached = resolved[k].second;
+    std::pair<StateByteMask::iterator, bool> insRez =
+      mask->insert(std::make_pair(mo, (BitArray *)0));
+    if (insRez.second) insRez.first->second = new BitArray(mo->size);
+    for (unsigned r = 0; r < cached->ranges.size(); ++r) {
+      for (unsigned j = cached->ranges[r].first;
+           j < cached->ranges[r].second && j < mo->size; ++j)
+        insRez.first->second->set(j);
+    }
+  }
+  return true;
+}
+
+void klee::storeCachedInvariant(const llvm::Loop *loop, KFunction *kf,
+                                const ExecutionState &headerState,
+                                const StateByteMask &mask) {
+  if (LoopInvariantCache.empty()) return;
+  if (!cachedInvariantsLoaded) loadCachedInvariants();
+
+  std::map<std::string, const MemoryObject *> byName;
+  std::set<std::string> ambiguous;
+  mapHavocNames(headerState, &byName, &ambiguous);
+
+  CachedInvariant invariant;
+  for (StateByteMask::const_iterator i = mask.begin(), e = mask.end();
+       i != e; ++i) {
+    const MemoryObject *mo = i->first;
+    std::map<const MemoryObject *, HavocInfo>::const_iterator havoc =
+      headerState.havocs.find(mo);
+    if (havoc == headerState.havocs.end()) {
+      // Undeclared (condoned) havocs have no stable name.
+      LOG_LA("Not caching the invariant, it changes an undeclared location.");
+      return;
+    }
+    if (ambiguous.count(havoc->second.name)) {
+      LOG_LA("Not caching the invariant, it changes the havoc "
+             << havoc->second.name << " of an ambiguous name.");
+      return;
+    }
+    CachedHavocMask cached;
+    cached.size = mo->size;
+    for (unsigned j = 0; j < mo->size; ++j) {
+      if (!i->second->get(j)) continue;
+      if (!cached.ranges.empty() && cached.ranges.back().second == j)
+        cached.ranges.back().second = j + 1;
+      else
+        cached.ranges.push_back(std::make_pair(j, j + 1));
+    }
+    invariant[havoc->second.name] = cached;
+  }
+  cachedInvariants[loopCacheKey(loop, kf)] = invariant;
+  saveCachedInvariants();
+}
+
+namespace {
+/// The --loop-analysis-stats records of the finished analyses.
+std::vector<std::string> loopAnalysisReports;
+}
+
+LoopAnalysisProfile::LoopAnalysisProfile()
+  : rounds(1), maskBytes(0), cacheHit(false),
+    startTime(util::getWallTime()) {}
+
+bool klee::loopAnalysisStatsEnabled() {
+  return LoopAnalysisStats;
+}
+
+void klee::recordLoopAnalysis(const llvm::Loop *loop, KFunction *kf,
+                              const LoopAnalysisProfile &profile) {
+  if (!LoopAnalysisStats) return;
+  std::string report;
+  llvm::raw_string_ostream os(report);
+  unsigned paths = 0;
+  uint64_t queries = 0;
+  uint64_t queriesSaved = 0;
+  uint64_t diffTime = 0;
+  for (unsigned i = 0; i < profile.rounds.size(); ++i) {
+    paths += profile.rounds[i].paths;
+    queries += profile.rounds[i].queries;
+    queriesSaved += profile.rounds[i].queriesSaved;
+    diffTime += profile.rounds[i].diffTime;
+  }
+  os << "loop " << loopLocation(loop, kf) << "\n"
+     << "  rounds: " << profile.rounds.size()
+     << ", paths: " << paths
+     << ", mask bytes: " << profile.maskBytes
+     << ", queries: " << queries
+     << ", queries saved: " << queriesSaved
+     << ", diff time: " << diffTime / 1000000.
+     << "s, wall time: " << util::getWallTime() - profile.startTime << "s\n";
+  for (unsigned i = 0; i < profile.rounds.size(); ++i) {
+    const LoopAnalysisProfile::Round &round = profile.rounds[i];
+    os << "  round " << i
+       << ": paths: " << round.paths
+       << ", new bytes: " << round.bytesAdded
+       << ", queries: " << round.queries
+       << ", diff time: " << round.diffTime / 1000000.
+       << "s, skipped paths: " << round.pathsSkipped
+       << ", worker paths: " << round.workerPaths << "\n";
+  }
+  if (!LoopInvariantCache.empty())
+    os << "  invariant cache: " << (profile.cacheHit ? "hit" : "miss") << "\n";
+  loopAnalysisReports.push_back(os.str());
+}
+
+void klee::writeLoopAnalysisStats(llvm::raw_ostream &os) {
+  for (unsigned i = 0; i < loopAnalysisReports.size(); ++i)
+    os << loopAnalysisReports[i];
+}
@@ -317,13 +317,29 @@ const Array *ObjectState::forgetThese(const BitArray *bytesToForget) {
 
   const Array *array =
     getArrayCache()->CreateArray(name, size);
-  UpdateList ul(array, 0);
+
+  // The fresh array becomes the root of the update list, so the
+  // remembered bytes that live only in the old list are moved to the cache
+  // first, to be written over the new root on the next flush.
+  for (unsigned i=0; i<size; i++) {
+    if (!bytesToForget->get(i) &&
+        !isByteConcrete(i) && !isByteKnownSymbolic(i)) {
+      ref<Expr> value = read8(i);
+      setKnownSymbolic(i, value.get());
+    }
+  }
+  if (flushMask) delete flushMask;
+  flushMask = new BitArray(size, true);
+  updates = UpdateList(array, 0);
+
+  // The forgotten bytes are left flushed, so that they are read straight
+  // from the fresh array, and a symbolic read does not need an update
+  // node per forgotten byte.
   for (unsigned i=0; i<size; i++) {
     if (bytesToForget->get(i)) {
       markByteSymbolic(i);
-      ref<Expr> read = ReadExpr::create(ul, ConstantExpr::alloc(i, Expr::Int32));
-      setKnownSymbolic(i, read.get());
-      markByteUnflushed(i);
+      setKnownSymbolic(i, 0);
+      flushMask->unset(i);
     }
   }
   //fprintf(stderr, "generated symbol %s\n", name.c_str());
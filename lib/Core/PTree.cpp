@@ -44,12 +44,45 @@ void PTree::remove(Node *n) {
         assert(n == p->right);
         p->right = 0;
       }
+    } else {
+      root = 0;
     }
     delete n;
     n = p;
   } while (n && !n->left && !n->right);
 }
 
+void PTree::detach(Node *n) {
+  assert(!n->left && !n->right);
+  Node *p = n->parent;
+  n->parent = 0;
+  if (!p) {
+    root = 0;
+    return;
+  }
+  if (n == p->left) {
+    p->left = 0;
+  } else {
+    assert(n == p->right);
+    p->right = 0;
+  }
+  if (!p->left && !p->right) remove(p);
+}
+
+void PTree::attach(Node *n) {
+  assert(!n->parent && n != root);
+  if (!root) {
+    root = n;
+    return;
+  }
+  Node *r = new Node(0, 0);
+  r->left = root;
+  r->right = n;
+  root->parent = r;
+  n->parent = r;
+  root = r;
+}
+
 void PTree::dump(llvm::raw_ostream &os) {
   ExprPPrinter *pp = ExprPPrinter::create(os);
   pp->setNewline("\\l");
@@ -29,6 +29,11 @@ namespace klee {
                                  const data_type &leftData,
                                  const data_type &rightData);
     void remove(Node *n);
+    /// Take the leaf \p n out of the tree without deleting it, so that
+    /// the random path searcher can not select its state.
+    void detach(Node *n);
+    /// Put a detached leaf back, as a new child of the root.
+    void attach(Node *n);
 
     void dump(llvm::raw_ostream &os);
   };
@@ -28,8 +28,10 @@
 #include "llvm/IR/Module.h"
 #include "llvm/ADT/Twine.h"
 #include "llvm/IR/DataLayout.h"
+#include "llvm/Support/Regex.h"
 
 #include <errno.h>
+#include <cstring>
 #include <sstream>
 
 using namespace llvm;
@@ -48,6 +50,21 @@ namespace {
                    cl::desc("Silently terminate paths with an infeasible "
                             "condition given to klee_assume() rather than "
                             "emitting an error (default=false)"));
+
+  cl::list<std::string>
+  TraceFunctions("trace-functions",
+                 cl::CommaSeparated,
+                 cl::desc("Only record the klee_trace_* calls of the functions "
+                          "whose name matches one of these regular expressions "
+                          "(default=all functions)"),
+                 cl::value_desc("regex list"));
+
+  cl::list<std::string>
+  TraceExclude("trace-exclude",
+               cl::CommaSeparated,
+               cl::desc("Ignore the klee_trace_* calls of the functions whose "
+                        "name matches one of these regular expressions"),
+               cl::value_desc("regex list"));
 }
 
 
@@ -219,8 +236,26 @@ int SpecialFunctionHandler::size() {
 	return sizeof(handlerInfo)/sizeof(handlerInfo[0]);
 }
 
+/// Stop on an invalid regular expression given to \a option, before
+/// std::regex throws on it.
+static void checkTraceRegex(const char *option, const std::string &regex) {
+  std::string error;
+  if (!llvm::Regex(regex).isValid(error))
+    klee_error("invalid regular expression \"%s\" given to --%s: %s",
+               regex.c_str(), option, error.c_str());
+}
+
 SpecialFunctionHandler::SpecialFunctionHandler(Executor &_executor) 
-  : executor(_executor) {}
+  : executor(_executor) {
+  for (unsigned i = 0; i < TraceFunctions.size(); ++i) {
+    checkTraceRegex("trace-functions", TraceFunctions[i]);
+    traceFunctionRegexes.push_back(std::regex(TraceFunctions[i]));
+  }
+  for (unsigned i = 0; i < TraceExclude.size(); ++i) {
+    checkTraceRegex("trace-exclude", TraceExclude[i]);
+    traceExcludeRegexes.push_back(std::regex(TraceExclude[i]));
+  }
+}
 
 
 void SpecialFunctionHandler::prepare() {
@@ -254,11 +289,29 @@ void SpecialFunctionHandler::bind() {
     HandlerInfo &hi = handlerInfo[i];
     Function *f = executor.kmodule->module->getFunction(hi.name);
     
-    if (f && (!hi.doNotOverride || f->isDeclaration()))
+    if (f && (!hi.doNotOverride || f->isDeclaration())) {
       handlers[f] = std::make_pair(hi.handler, hi.hasReturnValue);
+      if (!strncmp(hi.name, "klee_trace_", strlen("klee_trace_")))
+        traceHandlers.insert(f);
+    }
   }
 }
 
+bool SpecialFunctionHandler::isTracedFunction(const Function *f) {
+  std::map<const Function *, bool>::iterator it = tracedFunctions.find(f);
+  if (it != tracedFunctions.end())
+    return it->second;
+
+  std::string name = f->getName().str();
+  bool traced = traceFunctionRegexes.empty();
+  for (unsigned i = 0; !traced && i < traceFunctionRegexes.size(); ++i)
+    traced = std::regex_match(name, traceFunctionRegexes[i]);
+  for (unsigned i = 0; traced && i < traceExcludeRegexes.size(); ++i)
+    traced = !std::regex_match(name, traceExcludeRegexes[i]);
+  tracedFunctions[f] = traced;
+  return traced;
+}
+
 
 bool SpecialFunctionHandler::handle(ExecutionState &state, 
                                     Function *f,
@@ -272,6 +325,11 @@ bool SpecialFunctionHandler::handle(ExecutionState &state,
     if (!hasReturnValue && !target->inst->use_empty()) {
       executor.terminateStateOnExecError(state, 
                                          "expected return value from void special function");
+    } else if (traceHandlers.count(f) &&
+               !isTracedFunction(state.stack.back().kf->function)) {
+      // The traces of a filtered out function are dropped before reading
+      // any of their arguments, the function is then never recorded in
+      // the call path.
     } else {
       (this->*h)(state, target, arguments);
     }
@@ -302,15 +360,23 @@ SpecialFunctionHandler::readStringAtAddress(ExecutionState &state,
         Executor::TerminateReason::User);
     return "";
   }
-  bool res __attribute__ ((unused));
-  assert(executor.solver->mustBeTrue(state, 
-                                     EqExpr::create(address, 
-                                                    op.first->getBaseExpr()),
-                                     res) &&
-         res &&
+  assert(address->getZExtValue() == op.first->address &&
          "XXX interior pointer unhandled");
   const MemoryObject *mo = op.first;
   const ObjectState *os = op.second;
+  state.recordLoopReadObject(mo);
+
+  // The names given to the klee_trace_* functions are string literals,
+  // their contents never change, so read them only once.
+  bool immutable = os->readOnly;
+  if (const GlobalVariable *gv = dyn_cast_or_null<GlobalVariable>(mo->allocSite))
+    immutable |= gv->isConstant();
+  if (immutable) {
+    std::map<const MemoryObject *, std::string>::iterator it =
+      internedStrings.find(mo);
+    if (it != internedStrings.end())
+      return it->second;
+  }
 
   char *buf = new char[mo->size];
 
@@ -326,6 +392,8 @@ SpecialFunctionHandler::readStringAtAddress(ExecutionState &state,
   
   std::string result(buf);
   delete[] buf;
+  if (immutable)
+    internedStrings[mo] = result;
   return result;
 }
 
@@ -688,6 +756,7 @@ void SpecialFunctionHandler::handleGetErrno(ExecutionState &state,
   if (!resolved)
     executor.terminateStateOnError(state, "Could not resolve address for errno",
                                    Executor::User);
+  state.recordLoopReadObject(result.first);
   executor.bindLocal(target, state, result.second->read(0, Expr::Int32));
 }
 
@@ -1539,7 +1608,10 @@ void SpecialFunctionHandler::handleForgetAll
 
 void SpecialFunctionHandler::handleInduceInvariants
 (ExecutionState &state, KInstruction *target, std::vector<ref<Expr> > &arguments) {
-  state.induceInvariantsForThisLoop(target);
+  bool terminate = false;
+  state.induceInvariantsForThisLoop(target, &terminate);
+  if (terminate)
+    executor.terminateState(state);
 }
 
 void SpecialFunctionHandler::handleForbidAccess
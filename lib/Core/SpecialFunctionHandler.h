@@ -12,6 +12,8 @@
 
 #include <iterator>
 #include <map>
+#include <regex>
+#include <set>
 #include <vector>
 #include <string>
 
@@ -23,6 +25,7 @@ namespace klee {
   class Executor;
   class Expr;
   class ExecutionState;
+  class MemoryObject;
   struct KInstruction;
   template<typename T> class ref;
   
@@ -38,6 +41,20 @@ namespace klee {
     handlers_ty handlers;
     class Executor &executor;
 
+    /// The klee_trace_* handlers, and whether the calls they trace are
+    /// recorded for each function, following --trace-functions and
+    /// --trace-exclude.
+    std::set<const llvm::Function *> traceHandlers;
+    std::map<const llvm::Function *, bool> tracedFunctions;
+    std::vector<std::regex> traceFunctionRegexes;
+    std::vector<std::regex> traceExcludeRegexes;
+
+    bool isTracedFunction(const llvm::Function *f);
+
+    /// The strings read from the constant globals and the read-only
+    /// objects, which live as long as the executor.
+    std::map<const MemoryObject *, std::string> internedStrings;
+
     struct HandlerInfo {
       const char *name;
       SpecialFunctionHandler::Handler handler;
@@ -418,6 +418,9 @@ void StatsTracker::writeStatsHeader() {
              << "'ResolveTime',"
              << "'QueryCexCacheMisses',"
              << "'QueryCexCacheHits',"
+             << "'LoopAnalysisQueries',"
+             << "'LoopAnalysisDiffBytes',"
+             << "'LoopAnalysisQueriesSaved',"
 #ifdef KLEE_ARRAY_DEBUG
 	     << "'ArrayHashTime',"
 #endif
@@ -450,6 +453,9 @@ void StatsTracker::writeStatsLine() {
              << "," << stats::resolveTime / 1000000.
              << "," << stats::queryCexCacheMisses
              << "," << stats::queryCexCacheHits
+             << "," << stats::loopAnalysisQueries
+             << "," << stats::loopAnalysisDiffBytes
+             << "," << stats::loopAnalysisQueriesSaved
 #ifdef KLEE_ARRAY_DEBUG
              << "," << stats::arrayHashTime / 1000000.
 #endif
@@ -0,0 +1,152 @@
+//===-- ConstraintSlices.cpp ----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/util/ConstraintSlices.h"
+
+#include <algorithm>
+
+using namespace klee;
+
+unsigned ConstraintSlices::find(unsigned id) {
+  while (parent[id] != id) {
+    parent[id] = parent[parent[id]];
+    id = parent[id];
+  }
+  return id;
+}
+
+unsigned ConstraintSlices::arrayId(const Array *array) {
+  std::map<const Array *, unsigned>::iterator it = arrayIds.find(array);
+  if (it != arrayIds.end())
+    return it->second;
+  unsigned id = parent.size();
+  arrayIds[array] = id;
+  parent.push_back(id);
+  members.push_back(std::vector<unsigned>());
+  return id;
+}
+
+unsigned ConstraintSlices::unite(unsigned a, unsigned b) {
+  a = find(a);
+  b = find(b);
+  if (a == b)
+    return a;
+  // Move the smaller member list, each constraint moves O(log n) times.
+  if (members[a].size() < members[b].size())
+    std::swap(a, b);
+  parent[b] = a;
+  members[a].insert(members[a].end(), members[b].begin(), members[b].end());
+  std::vector<unsigned>().swap(members[b]);
+  return a;
+}
+
+void ConstraintSlices::clear() {
+  arrayIds.clear();
+  parent.clear();
+  members.clear();
+  indexedSize = 0;
+  lastIndexed = ref<Expr>();
+}
+
+void ConstraintSlices::update(const ConstraintManager &constraints) {
+  if (constraints.getRewrites() != rewrites ||
+      constraints.size() < indexedSize ||
+      (indexedSize &&
+       constraints.begin()[indexedSize - 1].get() != lastIndexed.get())) {
+    clear();
+    rewrites = constraints.getRewrites();
+  }
+
+  for (; indexedSize < constraints.size(); ++indexedSize) {
+    const ref<Expr> &constraint = constraints.begin()[indexedSize];
+    SymbolSet symbols = GetExprSymbols::visit(constraint);
+    if (symbols.empty())
+      continue;
+    SymbolSet::const_iterator si = symbols.begin(), se = symbols.end();
+    unsigned root = arrayId(*si);
+    for (++si; si != se; ++si)
+      root = unite(root, arrayId(*si));
+    members[find(root)].push_back(indexedSize);
+  }
+  if (indexedSize)
+    lastIndexed = constraints.begin()[indexedSize - 1];
+}
+
+std::vector<ref<Expr> >
+ConstraintSlices::getSlice(const ConstraintManager &constraints,
+                           const SymbolSet &symbols) {
+  return getSlice(constraints, symbols, std::vector<ref<Expr> >());
+}
+
+std::vector<ref<Expr> >
+ConstraintSlices::getSlice(const ConstraintManager &constraints,
+                           const SymbolSet &symbols,
+                           const std::vector<ref<Expr> > &extra) {
+  update(constraints);
+
+  // The extra constraints join the sets of the arrays they read, until
+  // none of the remaining ones reads a reached array.
+  SymbolSet reached = symbols;
+  std::vector<SymbolSet> extraSymbols;
+  std::vector<bool> included(extra.size(), false);
+  for (std::vector<ref<Expr> >::const_iterator it = extra.begin(),
+         ie = extra.end(); it != ie; ++it)
+    extraSymbols.push_back(GetExprSymbols::visit(*it));
+  std::vector<unsigned> roots;
+  for (bool changed = true; changed;) {
+    changed = false;
+    roots.clear();
+    for (SymbolSet::const_iterator si = reached.begin(), se = reached.end();
+         si != se; ++si) {
+      std::map<const Array *, unsigned>::iterator it = arrayIds.find(*si);
+      if (it != arrayIds.end())
+        roots.push_back(find(it->second));
+    }
+    std::sort(roots.begin(), roots.end());
+    roots.erase(std::unique(roots.begin(), roots.end()), roots.end());
+
+    for (unsigned i = 0; i < extra.size(); ++i) {
+      if (included[i])
+        continue;
+      for (SymbolSet::const_iterator si = extraSymbols[i].begin(),
+             se = extraSymbols[i].end(); si != se; ++si) {
+        std::map<const Array *, unsigned>::iterator it = arrayIds.find(*si);
+        if (reached.count(*si) ||
+            (it != arrayIds.end() &&
+             std::binary_search(roots.begin(), roots.end(),
+                                find(it->second)))) {
+          included[i] = true;
+          break;
+        }
+      }
+      if (included[i]) {
+        reached.insert(extraSymbols[i].begin(), extraSymbols[i].end());
+        changed = true;
+      }
+    }
+  }
+
+  std::vector<unsigned> positions;
+  for (std::vector<unsigned>::iterator it = roots.begin(), ie = roots.end();
+       it != ie; ++it)
+    positions.insert(positions.end(), members[*it].begin(),
+                     members[*it].end());
+  std::sort(positions.begin(), positions.end());
+
+  std::vector<ref<Expr> > slice;
+  slice.reserve(positions.size());
+  for (std::vector<unsigned>::iterator it = positions.begin(),
+         ie = positions.end(); it != ie; ++it)
+    slice.push_back(constraints.begin()[*it]);
+  for (unsigned i = 0; i < extra.size(); ++i) {
+    if (included[i])
+      slice.push_back(extra[i]);
+  }
+  return slice;
+}
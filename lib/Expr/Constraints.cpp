@@ -89,6 +89,8 @@ bool ConstraintManager::rewriteConstraints(ExprVisitor &visitor) {
       constraints.push_back(ce);
     }
   }
+  if (changed)
+    ++rewrites;
 
   return changed;
 }
@@ -1,27 +1,105 @@
 #include "klee/util/GetExprSymbols.h"
 
-namespace klee {
-template<>
-SymbolSet ExprAnalysis<GetExprSymbols,
-                       SymbolSet >::
-visitChildren(const Expr& expr) {
-  SymbolSet ret;
-  for (unsigned i = 0; i < expr.getNumKids(); ++i) {
-    ref<Expr> kid = expr.getKid(i);
-    SymbolSet symbols = visit(kid);
-    ret.insert(symbols.begin(), symbols.end());
+#include "llvm/Support/CommandLine.h"
+
+#include <algorithm>
+#include <iterator>
+
+using namespace klee;
+
+namespace {
+  llvm::cl::opt<unsigned>
+  ExprSymbolCacheSize("expr-symbol-cache-size",
+                      llvm::cl::init(100000),
+                      llvm::cl::desc("Number of expressions and update nodes whose arrays are memoized (default=100000)"));
+}
+
+ExprSymbolCache::ExprSymbolCache(unsigned _capacity) : capacity(_capacity) {
+  clear();
+}
+
+void ExprSymbolCache::clear() {
+  exprSets.clear();
+  updateSets.clear();
+  heldExprs.clear();
+  heldUpdates.clear();
+  setIds.clear();
+  sets.clear();
+  // The set 0 is the empty one.
+  getSetId(Arrays());
+}
+
+unsigned ExprSymbolCache::getSetId(const Arrays &arrays) {
+  std::pair<std::map<Arrays, unsigned>::iterator, bool> res =
+    setIds.insert(std::make_pair(arrays, sets.size()));
+  if (res.second)
+    sets.push_back(&res.first->first);
+  return res.first->second;
+}
+
+unsigned ExprSymbolCache::unite(unsigned a, unsigned b) {
+  if (a == b || b == 0) return a;
+  if (a == 0) return b;
+  Arrays arrays;
+  std::set_union(sets[a]->begin(), sets[a]->end(),
+                 sets[b]->begin(), sets[b]->end(),
+                 std::back_inserter(arrays));
+  return getSetId(arrays);
+}
+
+unsigned ExprSymbolCache::visitUpdates(const UpdateList &updates) {
+  // The update lists of the reads of an array share their tails, only walk
+  // down to the first node that was already visited.
+  std::vector<const UpdateNode *> pending;
+  const UpdateNode *un = updates.head;
+  for (; un && !updateSets.count(un); un = un->next)
+    pending.push_back(un);
+  unsigned id = un ? updateSets[un] : 0;
+
+  for (std::vector<const UpdateNode *>::reverse_iterator
+         it = pending.rbegin(), ie = pending.rend(); it != ie; ++it) {
+    id = unite(id, visitExpr((*it)->index));
+    id = unite(id, visitExpr((*it)->value));
+    updateSets[*it] = id;
   }
-  return ret;
+  if (!pending.empty())
+    heldUpdates.push_back(updates);
+  return id;
 }
 
 //TODO: rewrite in terms of individual read-exprs (parts of the
 // arrays), instead of using the array-granularity
-template<>
-SymbolSet ExprAnalysis<GetExprSymbols,
-                       SymbolSet >::
-visitRead(const ReadExpr& expr) {
-  SymbolSet ret = visit(expr.index);
-  ret.insert(expr.updates.root);
-  return ret;
+unsigned ExprSymbolCache::visitExpr(const ref<Expr> &e) {
+  if (isa<ConstantExpr>(e))
+    return 0;
+  llvm::DenseMap<const Expr *, unsigned>::iterator it = exprSets.find(e.get());
+  if (it != exprSets.end())
+    return it->second;
+
+  unsigned id = 0;
+  if (const ReadExpr *re = dyn_cast<ReadExpr>(e)) {
+    id = getSetId(Arrays(1, re->updates.root));
+    id = unite(id, visitExpr(re->index));
+    id = unite(id, visitUpdates(re->updates));
+  } else {
+    for (unsigned i = 0; i < e->getNumKids(); ++i)
+      id = unite(id, visitExpr(e->getKid(i)));
+  }
+  exprSets[e.get()] = id;
+  heldExprs.push_back(e);
+  return id;
+}
+
+SymbolSet ExprSymbolCache::getSymbols(const ref<Expr> &e) {
+  if (heldExprs.size() + heldUpdates.size() > capacity)
+    clear();
+  const Arrays &arrays = *sets[visitExpr(e)];
+  SymbolSet symbols;
+  symbols.insert(arrays.begin(), arrays.end());
+  return symbols;
 }
+
+SymbolSet GetExprSymbols::visit(const ref<Expr> &e) {
+  static ExprSymbolCache cache(ExprSymbolCacheSize);
+  return cache.getSymbols(e);
 }
@@ -387,6 +387,23 @@ KFunction::KFunction(llvm::Function *_function,
   dt.recalculate(*function);
   loopInfo.Analyze(dt);
 
+  for (llvm::Function::iterator bbit = function->begin(),
+         bbie = function->end(); bbit != bbie; ++bbit) {
+    const llvm::Loop *loop = loopInfo.getLoopFor(&*bbit);
+    if (!loop) continue;
+    for (llvm::BasicBlock::iterator it = bbit->begin(), ie = bbit->end();
+         it != ie; ++it) {
+      if (!isa<CallInst>(it)) continue;
+      CallSite cs(&*it);
+      Function *callee =
+        dyn_cast<Function>(cs.getCalledValue()->stripPointerCasts());
+      if (callee && callee->getName() == "klee_induce_invariants") {
+        invariantInductionLoops.insert(loop);
+        break;
+      }
+    }
+  }
+
   for (llvm::Function::iterator bbit = function->begin(), 
          bbie = function->end(); bbit != bbie; ++bbit) {
     BasicBlock *bb = &*bbit;
@@ -470,7 +487,14 @@ bool KFunction::insert(const llvm::Loop *loop,
   } else {
     delete insRez.first->second;
   }
-  insRez.first->second = new LoopEntryState(forgetMask, state.addressSpace);
+  std::vector<ref<Expr> > constraints(state.constraints.begin(),
+                                      state.constraints.end());
+  std::vector<ref<Expr> > locals;
+  const StackFrame &sf = state.stack.back();
+  for (unsigned i = 0; i < sf.kf->numRegisters; ++i)
+    locals.push_back(sf.locals[i].value);
+  insRez.first->second = new LoopEntryState(forgetMask, state.addressSpace,
+                                            constraints, locals);
   return insRez.second;
 }
 
@@ -1,6 +1,10 @@
 // RUN: %llvmgcc %s -emit-llvm -g -c -o %t1.bc
 // RUN: rm -rf %t.klee-out
-// RUN: %klee --output-dir=%t.klee-out --exit-on-error %t1.bc | FileCheck %s
+// RUN: %klee --output-dir=%t.klee-out --exit-on-error --loop-analysis-stats %t1.bc | FileCheck %s
+// RUN: FileCheck --check-prefix=CHECK-RANGE %s < %t.klee-out/loop-analysis.stats
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --exit-on-error --loop-analysis-stats --loop-analysis-diff-granularity=byte %t1.bc | FileCheck %s
+// RUN: FileCheck --check-prefix=CHECK-BYTE %s < %t.klee-out/loop-analysis.stats
 
 #include <klee/klee.h>
 #include <stdio.h>
@@ -8,8 +12,24 @@
 int main() {
   int x[3] = {1, 20, 3};
   klee_possibly_havoc(x, sizeof(x), "x");
+  int z = klee_int("z");
+  klee_assume(z > 5 & z < 7);
+  int y = 6;
+  klee_possibly_havoc(&y, sizeof(y), "y");
+  // The bytes of y differ structurally but not in value: one range query
+  // proves all four of them equal.
+  // CHECK-RANGE: mask bytes: 4, queries: {{[0-9]+}}, queries saved: {{[1-9]}}
+  // CHECK-BYTE: mask bytes: 4, queries: {{[0-9]+}}, queries saved: 0,
   while(klee_induce_invariants() & x[1]) {
     x[1] -- ;
+    y = z;
+    if (y == 6) {
+      printf("y may == 6\n");
+      // CHECK: y may == 6
+    } else {
+      printf("y may != 6\n");
+      // CHECK-NOT: y may != 6
+    }
     if (x[0] < 4) {
       printf("x[0] may be less than 4\n");
       // CHECK: x[0] may be less than 4
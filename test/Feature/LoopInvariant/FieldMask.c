@@ -0,0 +1,36 @@
+// RUN: %llvmgcc %s -emit-llvm -g -c -o %t1.bc
+// RUN: rm -rf %t.klee-out %t.field.klee-out
+// RUN: %klee --output-dir=%t.klee-out --exit-on-error %t1.bc | FileCheck %s --check-prefix=CHECK-BYTE
+// RUN: %klee --output-dir=%t.field.klee-out --exit-on-error --loop-analysis-field-masks %t1.bc > %t.field.log
+// RUN: FileCheck %s --check-prefix=CHECK-FIELD < %t.field.log
+// RUN: FileCheck %s --check-prefix=CHECK-TAG < %t.field.log
+
+#include <klee/klee.h>
+#include <stdio.h>
+
+struct counter {
+  unsigned flag;
+  unsigned char tag;
+  unsigned total;
+};
+
+int main() {
+  struct counter c = {0, 7, 5};
+  klee_possibly_havoc(&c, sizeof(c), "c");
+  while(klee_induce_invariants()) {
+    // Only the lowest byte of the flag may change.
+    c.flag ^= 1;
+    if (c.flag > 255) {
+      printf("flag may be big\n");
+      // CHECK-BYTE-NOT: flag may be big
+      // CHECK-FIELD: flag may be big
+    }
+    if (c.tag != 7) {
+      // Widening the flag must not reach the next field.
+      printf("tag may != 7\n");
+      // CHECK-BYTE-NOT: tag may != 7
+      // CHECK-TAG-NOT: tag may != 7
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,42 @@
+// RUN: %llvmgcc %s -emit-llvm -g -c -o %t1.bc
+// RUN: rm -rf %t.klee-out %t.klee-out2 %t.cache
+// RUN: %klee --output-dir=%t.klee-out --exit-on-error --loop-analysis-stats --loop-invariant-cache=%t.cache %t1.bc | FileCheck %s
+// RUN: FileCheck -check-prefix=CHECK-CACHE -input-file=%t.cache %s
+// RUN: FileCheck -check-prefix=CHECK-MISS -input-file=%t.klee-out/loop-analysis.stats %s
+// RUN: %klee --output-dir=%t.klee-out2 --exit-on-error --loop-analysis-stats --loop-invariant-cache=%t.cache %t1.bc | FileCheck %s
+// RUN: FileCheck -check-prefix=CHECK-HIT -input-file=%t.klee-out2/loop-analysis.stats %s
+
+#include <klee/klee.h>
+#include <stdio.h>
+
+int main() {
+  int x[3] = {1, 20, 3};
+  klee_possibly_havoc(x, sizeof(x), "x");
+  while(klee_induce_invariants() & x[1]) {
+    x[1] -- ;
+    if (x[0] < 4) {
+      printf("x[0] may be less than 4\n");
+      // CHECK: x[0] may be less than 4
+    } else {
+      printf("x[0] may be more\n");
+      // CHECK-NOT: x[0] may be more
+    }
+    if (x[1] < 100) {
+      printf("x[1] may be less than 100.\n");
+      // CHECK: x[1] may be less than 100.
+    } else {
+      printf("x[1] may be more\n");
+      // CHECK: x[1] may be more
+    }
+  }
+  printf("afterloop\n");
+  // CHECK: afterloop
+  return 0;
+}
+
+// CHECK-CACHE: loop main {{.*}}InvariantCache.c:13
+// CHECK-CACHE-NEXT: havoc 12 4-8 : x
+// CHECK-CACHE-NEXT: end
+
+// CHECK-MISS: invariant cache: miss
+// CHECK-HIT: invariant cache: hit
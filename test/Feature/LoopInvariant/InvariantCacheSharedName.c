@@ -0,0 +1,21 @@
+// RUN: %llvmgcc %s -emit-llvm -g -c -o %t1.bc
+// RUN: rm -rf %t.klee-out %t.klee-out2 %t.cache
+// RUN: %klee --output-dir=%t.klee-out --exit-on-error --loop-analysis-stats --loop-invariant-cache=%t.cache %t1.bc
+// RUN: %klee --output-dir=%t.klee-out2 --exit-on-error --loop-analysis-stats --loop-invariant-cache=%t.cache %t1.bc
+// RUN: FileCheck -input-file=%t.klee-out2/loop-analysis.stats %s
+
+// Both locations are named "x", so the name does not tell which one the
+// loop changes in another run, and the invariant is not cached.
+
+#include <klee/klee.h>
+
+int main() {
+  int x = 1, y = 20;
+  klee_possibly_havoc(&x, sizeof(x), "x");
+  klee_possibly_havoc(&y, sizeof(y), "x");
+  while(klee_induce_invariants() & y) {
+    y -- ;
+  }
+  // CHECK: invariant cache: miss
+  return x;
+}
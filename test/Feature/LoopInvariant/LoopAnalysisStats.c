@@ -0,0 +1,21 @@
+// RUN: %llvmgcc %s -emit-llvm -g -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --exit-on-error --loop-analysis-stats %t1.bc
+// RUN: FileCheck %s < %t.klee-out/loop-analysis.stats
+
+#include <klee/klee.h>
+
+int main() {
+  int x[3] = {1, 20, 3};
+  klee_possibly_havoc(x, sizeof(x), "x");
+  // CHECK: loop main {{.*}}LoopAnalysisStats.c:[[@LINE+1]]
+  while(klee_induce_invariants() & x[1]) {
+    x[1] -- ;
+  }
+  // CHECK-NEXT: rounds: {{[0-9]+}}, paths: {{[0-9]+}}, mask bytes: {{[1-4]}},
+  // CHECK-NEXT: round 0: paths: {{[0-9]+}}, new bytes: {{[1-4]}}, queries: {{[1-9]}}
+  // The last round finds nothing new.
+  // CHECK: new bytes: 0, queries: {{[0-9]+}}, diff time: {{.*}}s
+  // CHECK-NOT: round
+  return 0;
+}
@@ -0,0 +1,35 @@
+// RUN: %llvmgcc %s -emit-llvm -g -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --exit-on-error --loop-analysis-stats --loop-analysis-reuse-summaries %t1.bc | FileCheck %s
+// RUN: FileCheck %s --check-prefix=CHECK-STATS < %t.klee-out/loop-analysis.stats
+
+#include <klee/klee.h>
+#include <stdio.h>
+
+int x[3] = {1, 20, 3};
+
+void countdown() {
+  while(klee_induce_invariants() & x[1]) {
+    x[1] -- ;
+  }
+}
+
+int main() {
+  klee_possibly_havoc(x, sizeof(x), "x");
+  countdown();
+  // The second entry only differs in the havoced bytes.
+  countdown();
+  if (x[2] == 3) {
+    printf("x[2] kept\n");
+    // CHECK: x[2] kept
+  } else {
+    printf("x[2] lost\n");
+    // CHECK-NOT: x[2] lost
+  }
+  return 0;
+}
+
+// CHECK-STATS: loop countdown
+// CHECK-STATS-NEXT: rounds: {{[2-9]}},
+// CHECK-STATS: loop countdown
+// CHECK-STATS-NEXT: rounds: 1,
@@ -0,0 +1,38 @@
+// RUN: %llvmgcc %s -emit-llvm -g -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --exit-on-error --loop-analysis-stats --loop-analysis-skip-unaffected-paths %t1.bc | FileCheck %s
+// RUN: FileCheck -check-prefix=CHECK-STATS -input-file=%t.klee-out/loop-analysis.stats %s
+
+#include <klee/klee.h>
+#include <stdio.h>
+
+int main() {
+  unsigned char x = 3;
+  int y = 5;
+  int c = klee_int("c");
+  klee_possibly_havoc(&x, sizeof(x), "x");
+  klee_possibly_havoc(&y, sizeof(y), "y");
+  // Round 0 forgets x. Only then x < 2 is possible, so round 1 forgets y.
+  // The paths with !c do not read y and would repeat round 1 in round 2.
+  while(klee_induce_invariants() & x) {
+    x -- ;
+    if (c) {
+      if (x < 2)
+        y = 7;
+      if (y == 5) {
+        printf("y may == 5\n");
+        // CHECK: y may == 5
+      } else {
+        printf("y may != 5\n");
+        // CHECK: y may != 5
+      }
+    }
+  }
+  printf("afterloop\n");
+  // CHECK: afterloop
+  return 0;
+}
+
+// CHECK-STATS: round 1: paths: {{[0-9]+}}, new bytes: 1, {{.*}}, skipped paths: 0
+// CHECK-STATS-NEXT: round 2: paths: {{[0-9]+}}, new bytes: 0, {{.*}}, skipped paths: {{[1-9]}}
+// CHECK-STATS-NOT: round
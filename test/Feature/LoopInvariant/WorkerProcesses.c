@@ -0,0 +1,41 @@
+// RUN: %llvmgcc %s -emit-llvm -g -c -o %t1.bc
+// RUN: rm -rf %t.klee-out %t.workers-out
+// RUN: %klee --output-dir=%t.klee-out --exit-on-error --loop-analysis-stats %t1.bc | FileCheck %s
+// RUN: %klee --output-dir=%t.workers-out --exit-on-error --loop-analysis-stats --use-forked-solver=false --loop-analysis-workers=2 %t1.bc | FileCheck %s
+// The random path searcher must not pick the paths handed off to workers.
+// RUN: rm -rf %t.random-out
+// RUN: %klee --output-dir=%t.random-out --exit-on-error --search=random-path --use-forked-solver=false --loop-analysis-workers=2 %t1.bc | FileCheck %s
+// RUN: FileCheck -check-prefix=CHECK-WORKERS -input-file=%t.workers-out/loop-analysis.stats %s
+// The workers must find the same invariant in the same number of paths.
+// RUN: grep -o "rounds: [0-9]*, paths: [0-9]*, mask bytes: [0-9]*" %t.klee-out/loop-analysis.stats > %t.serial
+// RUN: grep -o "rounds: [0-9]*, paths: [0-9]*, mask bytes: [0-9]*" %t.workers-out/loop-analysis.stats > %t.workers
+// RUN: diff %t.serial %t.workers
+
+#include <klee/klee.h>
+#include <stdio.h>
+
+int main() {
+  int x[3] = {1, 20, 3};
+  klee_possibly_havoc(x, sizeof(x), "x");
+  // Once x[1] is forgotten, each round forks on both branches.
+  while(klee_induce_invariants() & x[1]) {
+    x[1] -- ;
+    if (x[1] < 10)
+      x[2] = 4;
+    if (x[1] & 1)
+      x[0] = 2;
+  }
+  // The workers must forget the same bytes as the main process.
+  if (x[2] == 4)
+    printf("x[2] may be 4\n");
+  else
+    printf("x[2] may be 3\n");
+  // CHECK-DAG: x[2] may be 4
+  // CHECK-DAG: x[2] may be 3
+  printf("afterloop\n");
+  // CHECK-DAG: afterloop
+  return 0;
+}
+
+// CHECK-WORKERS: loop main
+// CHECK-WORKERS: worker paths: {{[1-9]}}
@@ -0,0 +1,84 @@
+// REQUIRES: z3
+// RUN: %cxx -std=c++11 -shared -fPIC -I%S/../../../include %s -o %t.so
+// RUN: grep '^// CALL-PATH: ' %s | sed -e 's|^// CALL-PATH: ||' > %t.call_path
+// RUN: %stitch-perf-contract --contract=%t.so --jobs=1 %t.call_path > %t.jobs1 2> %t.jobs1.err
+// RUN: %stitch-perf-contract --contract=%t.so --jobs=4 %t.call_path > %t.jobs4 2> %t.jobs4.err
+// RUN: diff %t.jobs1 %t.jobs4
+// RUN: FileCheck %s < %t.jobs4
+// RUN: rm -rf %t.dir && mkdir %t.dir
+// RUN: cp %t.call_path %t.dir/a.call_path && cp %t.call_path %t.dir/b.call_path
+// RUN: %stitch-perf-contract --contract=%t.so --call-path-dir=%t.dir --workers=2 --jobs=2 2> %t.dir.err | FileCheck -check-prefix=CHECK-DIR %s
+// RUN: %stitch-perf-contract --contract=%t.so --call-path-dir=%t.dir --workers=1 --jobs=2 2> %t.dir1.err | FileCheck -check-prefix=CHECK-DIR %s
+
+// A contract for map_get whose cost depends on the initial value of x,
+// which the call path bounds to [0, 4). The candidates of x are split
+// across the jobs, and the bound must not depend on how.
+
+// CHECK: instructions,109
+// CHECK-NEXT: memory,7
+
+// CHECK-DIR: a.call_path,instructions,109
+// CHECK-DIR-NEXT: a.call_path,memory,7
+// CHECK-DIR-NEXT: b.call_path,instructions,109
+// CHECK-DIR-NEXT: b.call_path,memory,7
+// CHECK-DIR-NEXT: all,instructions,109
+// CHECK-DIR-NEXT: all,memory,7
+
+// CALL-PATH: ;;-- kQuery --
+// CALL-PATH: array initial_x[4] : w32 -> w8 = symbolic
+// CALL-PATH: (query [(Ult (ReadLSB w32 0 initial_x) 4)]
+// CALL-PATH:        false [(ReadLSB w32 0 initial_x)
+// CALL-PATH:               (ReadLSB w32 0 initial_x)])
+// CALL-PATH: ;;-- Calls --
+// CALL-PATH: 1:map_get(key:(ReadLSB w32 0 initial_x)) -> []
+// CALL-PATH: extra: x&1 = &[(ReadLSB w32 0 initial_x) -> (...)]
+// CALL-PATH: ;;-- Constraints --
+
+#include "klee/perf-contracts.h"
+
+extern "C" {
+void contract_init() {}
+
+std::set<std::string> contract_get_metrics() {
+  return {"instructions", "memory"};
+}
+
+std::map<std::string, std::string> contract_get_user_variables() {
+  return {};
+}
+
+std::map<std::string, std::set<std::string>>
+contract_get_optimization_variables() {
+  return {{"x", {"(w32 0)", "(w32 1)", "(w32 2)", "(w32 3)", "(w32 4)",
+                 "(w32 5)", "(w32 6)", "(w32 7)"}}};
+}
+
+std::set<std::string> contract_get_symbols() {
+  return {"array initial_x[4] : w32 -> w8 = symbolic",
+          "array current_x[4] : w32 -> w8 = symbolic"};
+}
+
+std::set<std::string> contract_get_contracts() { return {"map_get"}; }
+
+bool contract_has_contract(std::string function_name) {
+  return function_name == "map_get";
+}
+
+int contract_num_sub_contracts(std::string function_name) { return 2; }
+
+std::string contract_get_subcontract_constraints(std::string function_name,
+                                                 int sub_contract_idx) {
+  return sub_contract_idx == 0 ? "(Ult (ReadLSB w32 0 current_x) 2)"
+                               : "(Ule (w32 2) (ReadLSB w32 0 current_x))";
+}
+
+long contract_get_sub_contract_performance(
+    std::string function_name, int sub_contract_idx, std::string metric,
+    std::map<std::string, long> variables) {
+  long x = variables["x"];
+  if (metric == "instructions") {
+    return sub_contract_idx == 0 ? 10 + x : 100 + 3 * x;
+  }
+  return sub_contract_idx == 0 ? 2 * x : 4 + x;
+}
+}
@@ -0,0 +1,31 @@
+// RUN: %llvmgcc %s -emit-llvm -g -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --dump-call-traces --trace-functions=stub_.* --trace-exclude=stub_excluded %t1.bc
+// RUN: FileCheck -input-file=%t.klee-out/test000001.call_path %s
+// RUN: rm -rf %t.invalid-out
+// RUN: not %klee --output-dir=%t.invalid-out --trace-exclude="stub_(" %t1.bc 2>&1 | FileCheck -check-prefix=CHECK-INVALID %s
+
+#include <klee/klee.h>
+
+int stub_included(int x) {
+  klee_trace_ret();
+  klee_trace_param_i32(x, "x");
+  return x + 1;
+}
+
+int stub_excluded(int y) {
+  klee_trace_ret();
+  klee_trace_param_i32(y, "y");
+  return y + 2;
+}
+
+int main() {
+  int a = stub_excluded(1);
+  return stub_included(a) - 4;
+}
+
+// CHECK-NOT: stub_excluded
+// CHECK: stub_included(x:
+// CHECK-NOT: stub_excluded
+
+// CHECK-INVALID: invalid regular expression "stub_(" given to --trace-exclude
@@ -9,6 +9,7 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "klee/CallPath.h"
 #include "klee/Config/Version.h"
 #include "klee/ExecutionState.h"
 #include "klee/Expr.h"
@@ -23,6 +24,7 @@
 #include "klee/Interpreter.h"
 #include "klee/Statistics.h"
 #include "klee/ExprBuilder.h"
+#include "klee/util/ExprHashMap.h"
 #include "klee/util/ExprPPrinter.h"
 
 #include "llvm/IR/Constants.h"
@@ -54,13 +56,18 @@
 #include <sys/stat.h>
 #include <sys/wait.h>
 
+#include <atomic>
 #include <cerrno>
+#include <condition_variable>
+#include <deque>
 #include <fstream>
 #include <iomanip>
 #include <iterator>
+#include <mutex>
 #include <sstream>
 #include <list>
 #include <iostream>
+#include <thread>
 
 
 using namespace llvm;
@@ -171,6 +178,15 @@ namespace {
                                  "traces, generated according to klee_trace_*."),
                         cl::init(false));
 
+  cl::opt<unsigned>
+  CallPrefixDumpInterval("call-prefix-dump-interval",
+                         cl::desc("With --dump-call-trace-prefixes, write the "
+                                  "prefixes that no live state can extend "
+                                  "any more, and free their call trees, "
+                                  "after every this many paths (0=only at "
+                                  "the end, default=64)."),
+                         cl::init(64));
+
   cl::opt<bool>
   DumpCallTraces("dump-call-traces",
                  cl::desc("Dump call traces into separate file each. The call "
@@ -178,6 +194,35 @@ namespace {
                           "klee_trace_ret* intrinsic labels."),
                  cl::init(false));
 
+  enum CallPathFormatType {
+    TextCallPathFormat, SharedTextCallPathFormat, BinaryCallPathFormat
+  };
+
+  cl::opt<CallPathFormatType>
+  CallPathFormat("call-path-format",
+                 cl::desc("Choose the format of the .call_path files of "
+                          "--dump-call-traces (text by default)."),
+                 cl::values(clEnumValN(TextCallPathFormat, "text",
+                                       "kQuery followed by the calls"),
+                            clEnumValN(SharedTextCallPathFormat,
+                                       "shared-text",
+                                       "Text, with every expression printed "
+                                       "once in the kQuery and referred to "
+                                       "by the calls"),
+                            clEnumValN(BinaryCallPathFormat, "binary",
+                                       "Compact expression DAG, faster to "
+                                       "load by the call path tools")
+                            KLEE_LLVM_CL_VAL_END),
+                 cl::init(TextCallPathFormat));
+
+  cl::opt<unsigned>
+  OutputQueueSize("output-queue-size",
+                  cl::desc("Write the files of the test cases and call paths "
+                           "on a background thread, queueing up to this many "
+                           "of them while the execution goes on "
+                           "(0=write them synchronously, default=64)."),
+                  cl::init(64));
+
   cl::opt<bool>
   CondoneUndeclaredHavocs("condone-undeclared-havocs",
                           cl::desc("Do not throw an error if a memory location changes "
@@ -244,25 +289,97 @@ struct CallPathTip {
 
 class CallTree {
   std::vector<CallTree* > children;
+  // The children by the hash of their tip call.
+  std::map<unsigned, std::vector<CallTree* > > childIndex;
   CallPathTip tip;
+  // Whether the prefix files of this node were written.
+  bool dumped;
   std::vector<std::vector<CallPathTip*> > groupChildren();
+  CallTree *findChild(const CallInfo &call);
+  void clearChildren();
+  void dumpTipCallsSExpr(const std::list<CallInfo> &accumulated_prefix,
+                         KleeHandler* fileOpener);
+  bool dumpFinishedPrefixesSExpr(std::list<CallInfo> &accumulated_prefix,
+                                 const std::set<const CallTree *> &liveNodes,
+                                 const std::set<const CallTree *> &liveSubtrees,
+                                 KleeHandler* fileOpener);
 public:
-  CallTree():children(), tip(){};
-  void addCallPath(std::vector<CallInfo>::const_iterator path_begin,
-                   std::vector<CallInfo>::const_iterator path_end,
+  CallTree():children(), tip(), dumped(false){};
+  ~CallTree() { clearChildren(); }
+  void addCallPath(std::vector<const CallInfo *>::const_iterator path_begin,
+                   std::vector<const CallInfo *>::const_iterator path_end,
                    unsigned path_id);
   void dumpCallPrefixes(std::list<CallInfo> accumulated_prefix,
                         std::list<const std::vector<ref<Expr> >* >
                         accumulated_context,
                         KleeHandler* fileOpener);
-  void dumpCallPrefixesSExpr(std::list<CallInfo> accumulated_prefix,
-                             KleeHandler* fileOpener);
+  /// Write the prefixes that none of the \a livePrefixes can extend any
+  /// more, and free the subtrees that are completely written.
+  void dumpFinishedPrefixesSExpr(const std::vector<std::vector<const CallInfo *> >
+                                 &livePrefixes,
+                                 KleeHandler* fileOpener);
 
   int refCount;
 };
 
 /***/
 
+/// The files of a test case, or of a call path, captured on the executor
+/// thread. It only holds plain data: the reference counts of the
+/// expressions are not thread safe, so everything that refers to an
+/// expression is printed before the output is queued.
+struct TestCaseOutput {
+  /// The number of the test case, 0 for a call path.
+  unsigned id;
+  bool hasKTest;
+  std::vector< std::pair<std::string, std::vector<unsigned char> > > objects;
+  std::vector< HavocedLocation > havocs;
+  /// The other files, by name, in the order they are written.
+  std::deque< std::pair<std::string, std::string> > files;
+  double startTime;
+
+  TestCaseOutput() : id(0), hasKTest(false), startTime(0) {}
+
+  std::string &addFile(const std::string &name) {
+    files.push_back(std::make_pair(name, std::string()));
+    return files.back().second;
+  }
+};
+
+/// Writes the outputs of the terminated paths on a background thread, so
+/// that the executor does not wait on the file system. At most \a capacity
+/// outputs are queued, push() waits for the writer beyond that. With a
+/// capacity of 0 the outputs are written synchronously.
+class OutputWriter {
+  KleeHandler *handler;
+  unsigned capacity;
+  std::deque<TestCaseOutput *> queue;
+  bool writing, stopping;
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::thread thread;
+
+  void run();
+
+public:
+  OutputWriter(KleeHandler *handler, unsigned capacity);
+  ~OutputWriter();
+
+  /// Queue \a output for writing, taking its ownership.
+  void push(TestCaseOutput *output);
+  /// Wait until all the queued outputs are written.
+  void flush();
+};
+
+/// The output writer of the KleeHandler, drained when klee_error() or an
+/// interrupt exits before the handler is deleted.
+static OutputWriter *exitOutputWriter = 0;
+
+static void flushOutputAtExit() {
+  if (exitOutputWriter)
+    exitOutputWriter->flush();
+}
+
 class KleeHandler : public InterpreterHandler {
 private:
   Interpreter *m_interpreter;
@@ -272,10 +389,13 @@ private:
   SmallString<128> m_outputDirectory;
 
   unsigned m_numTotalTests;     // Number of tests received from the interpreter
-  unsigned m_numGeneratedTests; // Number of tests successfully generated
+  // Number of tests successfully generated, decremented by the output
+  // writer if the .ktest file can not be written
+  std::atomic<unsigned> m_numGeneratedTests;
   unsigned m_pathsExplored; // number of paths explored so far
   unsigned m_callPathIndex; // number of call path strings dumped so far
   unsigned m_callPathPrefixIndex; // number of call path strings dumped so far
+  unsigned m_callPathsSincePrefixDump; // number of call paths added to m_callTree since the last prefix dump
 
   // used for writing .ktest files
   int m_argc;
@@ -283,6 +403,8 @@ private:
 
   CallTree m_callTree;
 
+  OutputWriter *m_outputWriter;
+
 public:
   KleeHandler(int argc, char **argv);
   ~KleeHandler();
@@ -300,6 +422,11 @@ public:
                        const char *errorSuffix);
   void processCallPath(const ExecutionState &state);
 
+  /// Write the files of \a output, called by the output writer.
+  void writeTestCase(const TestCaseOutput &output);
+  /// Wait until the files of all the processed paths are written.
+  void flushOutput() { m_outputWriter->flush(); }
+
   std::string getOutputFilename(const std::string &filename);
   llvm::raw_fd_ostream *openOutputFile(const std::string &filename);
   std::string getTestFilename(const std::string &suffix, unsigned id);
@@ -316,13 +443,16 @@ public:
   llvm::raw_fd_ostream  *openNextCallPathPrefixFile();
 
   void dumpCallPathPrefixes();
+  void dumpFinishedCallPathPrefixes(const ExecutionState &terminatedState);
   void dumpCallPath(const ExecutionState &state, llvm::raw_ostream *file);
 };
 
 KleeHandler::KleeHandler(int argc, char **argv)
     : m_interpreter(0), m_pathWriter(0), m_symPathWriter(0), m_infoFile(0),
       m_outputDirectory(), m_numTotalTests(0), m_numGeneratedTests(0),
-      m_pathsExplored(0), m_callPathIndex(1), m_callPathPrefixIndex(0), m_argc(argc), m_argv(argv) {
+      m_pathsExplored(0), m_callPathIndex(1), m_callPathPrefixIndex(0),
+      m_callPathsSincePrefixDump(0), m_argc(argc), m_argv(argv),
+      m_outputWriter(0) {
 
   // create output directory (OutputDir or "klee-out-<i>")
   bool dir_given = OutputDir != "";
@@ -390,9 +520,16 @@ KleeHandler::KleeHandler(int argc, char **argv)
 
   // open info
   m_infoFile = openOutputFile("info");
+
+  m_outputWriter = new OutputWriter(this, OutputQueueSize);
+  exitOutputWriter = m_outputWriter;
+  atexit(flushOutputAtExit);
 }
 
 KleeHandler::~KleeHandler() {
+  // Write the queued outputs while the warning files are still open.
+  exitOutputWriter = 0;
+  delete m_outputWriter;
   delete m_pathWriter;
   delete m_symPathWriter;
   fclose(klee_warning_file);
@@ -449,199 +586,296 @@ llvm::raw_fd_ostream *KleeHandler::openTestFile(const std::string &suffix,
 }
 
 
-/* Outputs all files (.ktest, .kquery, .cov etc.) describing a test case */
+OutputWriter::OutputWriter(KleeHandler *_handler, unsigned _capacity)
+    : handler(_handler), capacity(_capacity), writing(false),
+      stopping(false) {
+  if (capacity)
+    thread = std::thread(&OutputWriter::run, this);
+}
+
+OutputWriter::~OutputWriter() {
+  if (!capacity)
+    return;
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    stopping = true;
+  }
+  changed.notify_all();
+  thread.join();
+}
+
+void OutputWriter::push(TestCaseOutput *output) {
+  if (!capacity) {
+    handler->writeTestCase(*output);
+    delete output;
+    return;
+  }
+  std::unique_lock<std::mutex> guard(mutex);
+  while (queue.size() >= capacity)
+    changed.wait(guard);
+  queue.push_back(output);
+  changed.notify_all();
+}
+
+void OutputWriter::flush() {
+  // The writer can not wait for itself, e.g. when it exits.
+  if (std::this_thread::get_id() == thread.get_id())
+    return;
+  std::unique_lock<std::mutex> guard(mutex);
+  while (!queue.empty() || writing)
+    changed.wait(guard);
+}
+
+void OutputWriter::run() {
+  std::unique_lock<std::mutex> guard(mutex);
+  for (;;) {
+    while (queue.empty() && !stopping)
+      changed.wait(guard);
+    // Stop only once everything queued is written.
+    if (queue.empty())
+      return;
+    TestCaseOutput *output = queue.front();
+    queue.pop_front();
+    writing = true;
+    changed.notify_all();
+
+    guard.unlock();
+    handler->writeTestCase(*output);
+    delete output;
+    guard.lock();
+
+    writing = false;
+    changed.notify_all();
+  }
+}
+
+/* Collects all files (.ktest, .kquery, .cov etc.) describing a test case,
+   they are written by the output writer */
 void KleeHandler::processTestCase(const ExecutionState &state,
                                   const char *errorMessage,
                                   const char *errorSuffix) {
   if (!NoOutput) {
-    std::vector< std::pair<std::string, std::vector<unsigned char> > > out;
-    std::vector< HavocedLocation > havocs;
-    bool success = m_interpreter->getSymbolicSolution(state, out, havocs);
+    TestCaseOutput *output = new TestCaseOutput;
+    // The solution needs the solver, it stays on the executor thread.
+    bool success = m_interpreter->getSymbolicSolution(state, output->objects,
+                                                      output->havocs);
 
     if (!success)
       klee_warning("unable to get symbolic solution, losing test case");
 
-    double start_time = util::getWallTime();
+    output->startTime = util::getWallTime();
 
     unsigned id = ++m_numTotalTests;
+    output->id = id;
+    output->hasKTest = success;
 
     if (success) {
-      KTest b;
-      b.numArgs = m_argc;
-      b.args = m_argv;
-      b.symArgvs = 0;
-      b.symArgvLen = 0;
-      b.numObjects = out.size();
-      b.objects = new KTestObject[b.numObjects];
-      assert(b.objects);
-      std::string *names = new std::string[b.numObjects];
-      for (unsigned i=0; i<b.numObjects; i++) {
-        KTestObject *o = &b.objects[i];
-        // Drop the '..._1' suffix
-        std::string name = out[i].first;
-        size_t last_underscore = out[i].first.rfind("_");
-        if (last_underscore != std::string::npos) {
-          bool all_digits = true;
-          for (unsigned j = last_underscore + 1; j < name.size(); ++j) {
-            if ('0' <= name[j] && name[j] <= '9') { //fine
-            } else {
-              all_digits = false;
-              break;
-            }
-          }
-          if (all_digits) {
-            name = name.substr(0, last_underscore);
-          }
-        }
-        names[i] = name;
-        o->name = const_cast<char*>(names[i].c_str());
-        o->numBytes = out[i].second.size();
-        o->bytes = new unsigned char[o->numBytes];
-        assert(o->bytes);
-        std::copy(out[i].second.begin(), out[i].second.end(), o->bytes);
-      }
-      b.numHavocs = havocs.size();
-      b.havocs = new KTestHavocedLocation[b.numHavocs];
-      assert(b.havocs);
-      for (unsigned i=0; i<b.numHavocs; i++) {
-        KTestHavocedLocation *o = &b.havocs[i];
-        o->name = const_cast<char*>(havocs[i].name.c_str());
-        o->numBytes = havocs[i].value.size();
-        o->bytes = new unsigned char[o->numBytes];
-        assert(o->bytes);
-        std::copy(havocs[i].value.begin(), havocs[i].value.end(), o->bytes);
-        unsigned mask_size = (o->numBytes + 31)/32*4;
-        assert(mask_size <= havocs[i].mask.size());
-        o->mask = new uint32_t[mask_size/sizeof(uint32_t)];
-        assert(o->mask);
-        memcpy(o->mask, havocs[i].mask.get_bits(), mask_size);
-        // printf("dumping mask for %s: ", o->name);
-        // for (unsigned i = 0; i < mask_size/4*32; ++i) {
-        //   uint32_t word = i / 32;
-        //   uint32_t bit_id = (i - word * 32);
-        //   uint32_t bit_mask = 1 << bit_id;
-        //   printf("%s", (bit_mask & o->mask[word]) ? "1" : "0");
-        // }
-        // printf("\n");
-        // fflush(stdout);
-      }
-
-      if (!kTest_toFile(&b, getOutputFilename(getTestFilename("ktest", id)).c_str())) {
-        klee_warning("unable to write output test case, losing it");
-      } else {
-        ++m_numGeneratedTests;
-      }
+      ++m_numGeneratedTests;
 
       if (DumpCallTraces && !errorMessage) {
-        llvm::raw_fd_ostream *trace_file =
-          openOutputFile(getTestFilename("call_path", id));
-        dumpCallPath(state, trace_file);
-        delete trace_file;
+        llvm::raw_string_ostream trace_file(
+          output->addFile(getTestFilename("call_path", id)));
+        dumpCallPath(state, &trace_file);
       }
-
-      for (unsigned i=0; i<b.numObjects; i++)
-        delete[] b.objects[i].bytes;
-      delete[] b.objects;
-      delete[] names;
     }
 
     if (errorMessage) {
-      llvm::raw_ostream *f = openTestFile(errorSuffix, id);
-      *f << errorMessage;
-      delete f;
+      output->addFile(getTestFilename(errorSuffix, id)) = errorMessage;
     }
 
     if (m_pathWriter) {
       std::vector<unsigned char> concreteBranches;
       m_pathWriter->readStream(m_interpreter->getPathStreamID(state),
                                concreteBranches);
-      llvm::raw_fd_ostream *f = openTestFile("path", id);
+      llvm::raw_string_ostream f(output->addFile(getTestFilename("path", id)));
       for (std::vector<unsigned char>::iterator I = concreteBranches.begin(),
                                                 E = concreteBranches.end();
            I != E; ++I) {
-        *f << *I << "\n";
+        f << *I << "\n";
       }
-      delete f;
     }
 
     if (errorMessage || WriteKQueries) {
-      std::string constraints;
-      m_interpreter->getConstraintLog(state, constraints,Interpreter::KQUERY);
-      llvm::raw_ostream *f = openTestFile("kquery", id);
-      *f << constraints;
-      delete f;
+      m_interpreter->getConstraintLog(state,
+                                      output->addFile(getTestFilename("kquery", id)),
+                                      Interpreter::KQUERY);
     }
 
     if (WriteCVCs) {
       // FIXME: If using Z3 as the core solver the emitted file is actually
       // SMT-LIBv2 not CVC which is a bit confusing
-      std::string constraints;
-      m_interpreter->getConstraintLog(state, constraints, Interpreter::STP);
-      llvm::raw_ostream *f = openTestFile("cvc", id);
-      *f << constraints;
-      delete f;
+      m_interpreter->getConstraintLog(state,
+                                      output->addFile(getTestFilename("cvc", id)),
+                                      Interpreter::STP);
     }
 
     if(WriteSMT2s) {
-      std::string constraints;
-        m_interpreter->getConstraintLog(state, constraints, Interpreter::SMTLIB2);
-        llvm::raw_ostream *f = openTestFile("smt2", id);
-        *f << constraints;
-        delete f;
+      m_interpreter->getConstraintLog(state,
+                                      output->addFile(getTestFilename("smt2", id)),
+                                      Interpreter::SMTLIB2);
     }
 
     if (m_symPathWriter) {
       std::vector<unsigned char> symbolicBranches;
       m_symPathWriter->readStream(m_interpreter->getSymbolicPathStreamID(state),
                                   symbolicBranches);
-      llvm::raw_fd_ostream *f = openTestFile("sym.path", id);
+      llvm::raw_string_ostream f(output->addFile(getTestFilename("sym.path", id)));
       for (std::vector<unsigned char>::iterator I = symbolicBranches.begin(), E = symbolicBranches.end(); I!=E; ++I) {
-        *f << *I << "\n";
+        f << *I << "\n";
      }
-      delete f;
     }
 
     if (WriteCov) {
       std::map<const std::string*, std::set<unsigned> > cov;
       m_interpreter->getCoveredLines(state, cov);
-      llvm::raw_ostream *f = openTestFile("cov", id);
+      llvm::raw_string_ostream f(output->addFile(getTestFilename("cov", id)));
       for (std::map<const std::string*, std::set<unsigned> >::iterator
              it = cov.begin(), ie = cov.end();
            it != ie; ++it) {
         for (std::set<unsigned>::iterator
                it2 = it->second.begin(), ie = it->second.end();
              it2 != ie; ++it2)
-          *f << *it->first << ":" << *it2 << "\n";
+          f << *it->first << ":" << *it2 << "\n";
       }
-      delete f;
     }
 
-    if (m_numGeneratedTests == StopAfterNTests)
+    if (StopAfterNTests && m_numGeneratedTests >= StopAfterNTests)
       m_interpreter->setHaltExecution(true);
 
-    if (WriteTestInfo) {
-      double elapsed_time = util::getWallTime() - start_time;
-      llvm::raw_ostream *f = openTestFile("info", id);
-      *f << "Time to generate test case: "
-         << elapsed_time << "s\n";
-      delete f;
-    }
+    m_outputWriter->push(output);
   }
   
   if (errorMessage && OptExitOnError) {
+    flushOutput();
     m_interpreter->prepareForEarlyExit();
     klee_error("EXITING ON ERROR:\n%s\n", errorMessage);
   }
 }
 
-bool dumpCallInfo(const CallInfo& ci, llvm::raw_ostream& file) {
+/* Outputs all files (.ktest, .kquery, .cov etc.) describing a test case */
+void KleeHandler::writeTestCase(const TestCaseOutput &output) {
+  const std::vector< std::pair<std::string, std::vector<unsigned char> > >
+    &out = output.objects;
+  const std::vector< HavocedLocation > &havocs = output.havocs;
+
+  if (output.hasKTest) {
+    KTest b;
+    b.numArgs = m_argc;
+    b.args = m_argv;
+    b.symArgvs = 0;
+    b.symArgvLen = 0;
+    b.numObjects = out.size();
+    b.objects = new KTestObject[b.numObjects];
+    assert(b.objects);
+    std::string *names = new std::string[b.numObjects];
+    for (unsigned i=0; i<b.numObjects; i++) {
+      KTestObject *o = &b.objects[i];
+      // Drop the '..._1' suffix
+      std::string name = out[i].first;
+      size_t last_underscore = out[i].first.rfind("_");
+      if (last_underscore != std::string::npos) {
+        bool all_digits = true;
+        for (unsigned j = last_underscore + 1; j < name.size(); ++j) {
+          if ('0' <= name[j] && name[j] <= '9') { //fine
+          } else {
+            all_digits = false;
+            break;
+          }
+        }
+        if (all_digits) {
+          name = name.substr(0, last_underscore);
+        }
+      }
+      names[i] = name;
+      o->name = const_cast<char*>(names[i].c_str());
+      o->numBytes = out[i].second.size();
+      o->bytes = new unsigned char[o->numBytes];
+      assert(o->bytes);
+      std::copy(out[i].second.begin(), out[i].second.end(), o->bytes);
+    }
+    b.numHavocs = havocs.size();
+    b.havocs = new KTestHavocedLocation[b.numHavocs];
+    assert(b.havocs);
+    for (unsigned i=0; i<b.numHavocs; i++) {
+      KTestHavocedLocation *o = &b.havocs[i];
+      o->name = const_cast<char*>(havocs[i].name.c_str());
+      o->numBytes = havocs[i].value.size();
+      o->bytes = new unsigned char[o->numBytes];
+      assert(o->bytes);
+      std::copy(havocs[i].value.begin(), havocs[i].value.end(), o->bytes);
+      unsigned mask_size = (o->numBytes + 31)/32*4;
+      assert(mask_size <= havocs[i].mask.size());
+      o->mask = new uint32_t[mask_size/sizeof(uint32_t)];
+      assert(o->mask);
+      memcpy(o->mask, havocs[i].mask.get_bits(), mask_size);
+    }
+
+    if (!kTest_toFile(&b, getOutputFilename(getTestFilename("ktest", output.id)).c_str())) {
+      klee_warning("unable to write output test case, losing it");
+      --m_numGeneratedTests;
+    }
+
+    for (unsigned i=0; i<b.numObjects; i++)
+      delete[] b.objects[i].bytes;
+    delete[] b.objects;
+    delete[] names;
+  }
+
+  for (std::deque< std::pair<std::string, std::string> >::const_iterator
+         it = output.files.begin(), ie = output.files.end(); it != ie; ++it) {
+    llvm::raw_ostream *f = openOutputFile(it->first);
+    if (!f)
+      continue;
+    *f << it->second;
+    delete f;
+  }
+
+  if (WriteTestInfo && output.id) {
+    double elapsed_time = util::getWallTime() - output.startTime;
+    llvm::raw_ostream *f = openTestFile("info", output.id);
+    *f << "Time to generate test case: "
+       << elapsed_time << "s\n";
+    delete f;
+  }
+}
+
+/// The traced values of a call path dumped with
+/// --call-path-format=shared-text. Each distinct expression is printed
+/// once, as a value of the kQuery, and the calls refer to it as (@index).
+class SharedCallPathExprs {
+  ExprHashMap<unsigned> indices;
+
+public:
+  std::vector<ref<Expr> > exprs;
+
+  unsigned indexOf(const ref<Expr> &e) {
+    ExprHashMap<unsigned>::iterator it = indices.find(e);
+    if (it != indices.end())
+      return it->second;
+    unsigned index = exprs.size();
+    indices[e] = index;
+    exprs.push_back(e);
+    return index;
+  }
+};
+
+static void printCallExpr(const ref<Expr> &e, llvm::raw_ostream &file,
+                          SharedCallPathExprs *shared) {
+  if (shared)
+    file << "(@" << shared->indexOf(e) << ")";
+  else
+    file << *e;
+}
+
+bool dumpCallInfo(const CallInfo& ci, llvm::raw_ostream& file,
+                  SharedCallPathExprs *shared = 0) {
   file << ci.callPlace.getLine() <<":" <<ci.f->getName() <<"(";
   assert(ci.returned);
   for (std::vector< CallArg >::const_iterator argIter = ci.args.begin(),
          end = ci.args.end(); argIter != end; ++argIter) {
     const CallArg *arg = &*argIter;
     file <<arg->name <<":";
-    file <<*arg->expr;
+    printCallExpr(arg->expr, file, shared);
     if (arg->isPtr) {
       file <<"&";
       if (arg->funPtr == NULL) {
@@ -649,13 +883,13 @@ bool dumpCallInfo(const CallInfo& ci, llvm::raw_ostream& file) {
             arg->pointee.doTraceValueOut) {
           file <<"[";
           if (arg->pointee.doTraceValueIn) {
-            file <<*arg->pointee.inVal;
+            printCallExpr(arg->pointee.inVal, file, shared);
           }
           if (arg->pointee.doTraceValueOut &&
               arg->pointee.outVal.isNull()) return false;
           file <<"->";
           if (arg->pointee.doTraceValueOut) {
-            file <<*arg->pointee.outVal;
+            printCallExpr(arg->pointee.outVal, file, shared);
           }
           file <<"]";
           std::map<int, FieldDescr>::const_iterator i =
@@ -666,13 +900,13 @@ bool dumpCallInfo(const CallInfo& ci, llvm::raw_ostream& file) {
             if (i->second.doTraceValueIn ||
                 i->second.doTraceValueOut) {
               if (i->second.doTraceValueIn) {
-                file <<*i->second.inVal;
+                printCallExpr(i->second.inVal, file, shared);
               }
               file << "->";
               if (i->second.doTraceValueOut &&
                   i->second.outVal.isNull()) return false;
               if (i->second.doTraceValueOut) {
-                file <<*i->second.outVal;
+                printCallExpr(i->second.outVal, file, shared);
               }
               file <<"]";
             } else {
@@ -693,19 +927,22 @@ bool dumpCallInfo(const CallInfo& ci, llvm::raw_ostream& file) {
   if (ci.ret.expr.isNull()) {
     file <<"[]";
   } else {
-    file <<*ci.ret.expr;
+    printCallExpr(ci.ret.expr, file, shared);
     if (ci.ret.isPtr) {
       file <<"&";
       if (ci.ret.funPtr == NULL) {
         if (ci.ret.pointee.doTraceValueOut) {
-          file <<"[" <<*ci.ret.pointee.outVal <<"]";
+          file <<"[";
+          printCallExpr(ci.ret.pointee.outVal, file, shared);
+          file <<"]";
           std::map<int, FieldDescr>::const_iterator
             i = ci.ret.pointee.fields.begin(),
             e = ci.ret.pointee.fields.end();
           for (; i != e; ++i) {
             file <<"[" <<i->second.name <<":";
             if (i->second.doTraceValueOut) {
-              file <<*i->second.outVal << "]";
+              printCallExpr(i->second.outVal, file, shared);
+              file << "]";
             } else {
               file <<"(...)]";
             }
@@ -724,12 +961,13 @@ bool dumpCallInfo(const CallInfo& ci, llvm::raw_ostream& file) {
     const CallExtraPtr *extra_ptr = &(*i).second;
     file <<"extra: " <<extra_ptr->name <<"&" <<extra_ptr->ptr <<" = &[";
     if (extra_ptr->pointee.doTraceValueIn) {
-      file <<extra_ptr->pointee.inVal;
+      printCallExpr(extra_ptr->pointee.inVal, file, shared);
     } else {
       file <<"(...)";
     }
     if (extra_ptr->pointee.doTraceValueOut) {
-      file <<" -> " <<extra_ptr->pointee.outVal;
+      file <<" -> ";
+      printCallExpr(extra_ptr->pointee.outVal, file, shared);
     } else {
       file <<"-> (...)";
     }
@@ -919,10 +1157,15 @@ bool dumpCallInfoSExpr(const CallInfo& ci, llvm::raw_ostream& file) {
 
 void KleeHandler::processCallPath(const ExecutionState &state) {
   unsigned id = m_callPathIndex;
-  if (DumpCallTracePrefixes)
-    m_callTree.addCallPath(state.callPath.begin(),
-                           state.callPath.end(),
-                           id);
+  std::vector<const CallInfo *> calls = state.callPath.elements();
+  if (DumpCallTracePrefixes) {
+    m_callTree.addCallPath(calls.begin(), calls.end(), id);
+    if (CallPrefixDumpInterval &&
+        ++m_callPathsSincePrefixDump == CallPrefixDumpInterval) {
+      m_callPathsSincePrefixDump = 0;
+      dumpFinishedCallPathPrefixes(state);
+    }
+  }
 
   if (!DumpCallTraces) return;
 
@@ -930,19 +1173,22 @@ void KleeHandler::processCallPath(const ExecutionState &state) {
 
   std::stringstream filename;
   filename << "call-path" << std::setfill('0') << std::setw(6) << id << '.' << "txt";
-  llvm::raw_ostream *file = openOutputFile(filename.str());
-  for (std::vector<CallInfo>::const_iterator iter = state.callPath.begin(),
-         end = state.callPath.end(); iter != end; ++iter) {
-    const CallInfo& ci = *iter;
-    bool dumped = dumpCallInfo(ci, *file);
-    if (!dumped) break;
-  }
-  *file <<";;-- Constraints --\n";
-  for (ConstraintManager::constraint_iterator ci = state.constraints.begin(),
-         cEnd = state.constraints.end(); ci != cEnd; ++ci) {
-    *file <<**ci<<"\n";
+  TestCaseOutput *output = new TestCaseOutput;
+  {
+    llvm::raw_string_ostream file(output->addFile(filename.str()));
+    for (std::vector<const CallInfo *>::const_iterator iter = calls.begin(),
+           end = calls.end(); iter != end; ++iter) {
+      const CallInfo& ci = **iter;
+      bool dumped = dumpCallInfo(ci, file);
+      if (!dumped) break;
+    }
+    file <<";;-- Constraints --\n";
+    for (ConstraintManager::constraint_iterator ci = state.constraints.begin(),
+           cEnd = state.constraints.end(); ci != cEnd; ++ci) {
+      file <<**ci<<"\n";
+    }
   }
-  delete file;
+  m_outputWriter->push(output);
 }
 
 llvm::raw_fd_ostream *KleeHandler::openNextCallPathPrefixFile() {
@@ -953,35 +1199,119 @@ llvm::raw_fd_ostream *KleeHandler::openNextCallPathPrefixFile() {
 }
 
 void KleeHandler::dumpCallPathPrefixes() {
-  m_callTree.dumpCallPrefixesSExpr(std::list<CallInfo>(), this);
+  // No state is left, everything is finished.
+  m_callTree.dumpFinishedPrefixesSExpr(
+    std::vector<std::vector<const CallInfo *> >(), this);
   //m_callTree.dumpCallPrefixes(std::list<CallInfo>(), std::list<const std::vector<ref<Expr> >* >(), this);
 }
 
+void KleeHandler::dumpFinishedCallPathPrefixes(const ExecutionState
+                                               &terminatedState) {
+  std::vector<std::vector<const CallInfo *> > livePrefixes;
+  m_interpreter->getLiveCallPathPrefixes(&terminatedState, livePrefixes);
+  m_callTree.dumpFinishedPrefixesSExpr(livePrefixes, this);
+}
+
+/// Collect the values of the call that the call path tools read from the
+/// text format. Fails where dumpCallInfo fails, on an unfinished call.
+static bool getCallPathCall(const CallInfo &ci, CallPathCall &call) {
+  call.function_name = ci.f->getName().str();
+  for (std::vector<CallArg>::const_iterator argIter = ci.args.begin(),
+         end = ci.args.end(); argIter != end; ++argIter) {
+    const CallArg &arg = *argIter;
+    if (!arg.isPtr) {
+      call.args[arg.name].first = arg.expr;
+      continue;
+    }
+    if (arg.funPtr != NULL)
+      continue;
+
+    const FieldDescr &pointee = arg.pointee;
+    if (pointee.doTraceValueOut && pointee.outVal.isNull())
+      return false;
+    for (std::map<int, FieldDescr>::const_iterator i = pointee.fields.begin(),
+           e = pointee.fields.end(); i != e; ++i) {
+      if (i->second.doTraceValueOut && i->second.outVal.isNull())
+        return false;
+    }
+    if (!pointee.doTraceValueIn && !pointee.doTraceValueOut)
+      continue;
+    CallPathCall::BeforeAfter &value = call.args[arg.name];
+    if (pointee.doTraceValueIn)
+      value.first = pointee.inVal;
+    if (pointee.doTraceValueOut)
+      value.second = pointee.outVal;
+  }
+  for (std::map<size_t, CallExtraPtr>::const_iterator i = ci.extraPtrs.begin(),
+         e = ci.extraPtrs.end(); i != e; ++i) {
+    const FieldDescr &pointee = i->second.pointee;
+    CallPathCall::BeforeAfter &value = call.extra_vars[i->second.name];
+    if (pointee.doTraceValueIn)
+      value.first = pointee.inVal;
+    if (pointee.doTraceValueOut)
+      value.second = pointee.outVal;
+  }
+  return true;
+}
+
 void KleeHandler::dumpCallPath(const ExecutionState &state, llvm::raw_ostream *file) {
+  if (CallPathFormat == BinaryCallPathFormat) {
+    std::vector<CallPathCall> calls;
+    std::vector<const CallInfo *> callInfos = state.callPath.elements();
+    for (std::vector<const CallInfo *>::const_iterator
+           iter = callInfos.begin(), end = callInfos.end();
+         iter != end; ++iter) {
+      calls.push_back(CallPathCall());
+      if (!getCallPathCall(**iter, calls.back())) {
+        calls.pop_back();
+        break;
+      }
+    }
+    writeBinaryCallPath(*file, calls, state.constraints);
+    return;
+  }
+
   std::vector<klee::ref<klee::Expr> > evalExprs;
   std::vector<const klee::Array *> evalArrays;
-
-  for (auto ci : state.callPath) {
-    for (auto a : ci.args) {
-      if (a.isPtr) {
-        if (a.pointee.doTraceValueIn) {
-          evalExprs.push_back(a.pointee.inVal);
-        }
+  std::vector<const CallInfo *> calls = state.callPath.elements();
+
+  // The shared calls are printed first, to number the expressions they
+  // refer to, which then become the values of the kQuery.
+  bool sharedExprs = CallPathFormat == SharedTextCallPathFormat;
+  SharedCallPathExprs shared;
+  std::string callsStr;
+  llvm::raw_string_ostream callsROS(callsStr);
+  if (sharedExprs) {
+    for (std::vector<const CallInfo *>::const_iterator iter = calls.begin(),
+           end = calls.end(); iter != end; ++iter) {
+      if (!dumpCallInfo(**iter, callsROS, &shared)) break;
+    }
+    callsROS.flush();
+    evalExprs = shared.exprs;
+  } else {
+    for (auto cip : calls) {
+      const CallInfo &ci = *cip;
+      for (auto a : ci.args) {
+        if (a.isPtr) {
+          if (a.pointee.doTraceValueIn) {
+            evalExprs.push_back(a.pointee.inVal);
+          }
       
-        if (a.pointee.doTraceValueOut) {
-          evalExprs.push_back(a.pointee.outVal);
+          if (a.pointee.doTraceValueOut) {
+            evalExprs.push_back(a.pointee.outVal);
+          }
+        } else {
+          evalExprs.push_back(a.expr);
         }
-      } else {
-        evalExprs.push_back(a.expr);
       }
-    }
 
-    for (auto e : ci.extraPtrs) {
-      if (e.second.pointee.doTraceValueIn) {
-        evalExprs.push_back(e.second.pointee.inVal);
-      }
-      if (e.second.pointee.doTraceValueOut) {
-        evalExprs.push_back(e.second.pointee.outVal);
+      for (auto e : ci.extraPtrs) {
+        if (e.second.pointee.doTraceValueIn) {
+          evalExprs.push_back(e.second.pointee.inVal);
+        }
+        if (e.second.pointee.doTraceValueOut) {
+          evalExprs.push_back(e.second.pointee.outVal);
+        }
       }
     }
   }
@@ -999,13 +1329,19 @@ void KleeHandler::dumpCallPath(const ExecutionState &state, llvm::raw_ostream *f
   *file << kleaverROS.str();
 
   *file <<";;-- Calls --\n";
-  for (std::vector<CallInfo>::const_iterator iter = state.callPath.begin(),
-         end = state.callPath.end(); iter != end; ++iter) {
-    const CallInfo& ci = *iter;
-    bool dumped = dumpCallInfo(ci, *file);
-    if (!dumped) break;
+  if (sharedExprs) {
+    *file << callsROS.str();
+  } else {
+    for (std::vector<const CallInfo *>::const_iterator iter = calls.begin(),
+           end = calls.end(); iter != end; ++iter) {
+      const CallInfo& ci = **iter;
+      bool dumped = dumpCallInfo(ci, *file);
+      if (!dumped) break;
+    }
   }
   *file <<";;-- Constraints --\n";
+  // The shared format does not repeat the constraints of the kQuery.
+  if (sharedExprs) return;
   for (ConstraintManager::constraint_iterator ci = state.constraints.begin(),
          cEnd = state.constraints.end(); ci != cEnd; ++ci) {
     *file <<**ci<<"\n";
@@ -1093,35 +1429,60 @@ std::string KleeHandler::getRunTimeLibraryPath(const char *argv0) {
   return libDir.str();
 }
 
-void CallTree::addCallPath(std::vector<CallInfo>::const_iterator path_begin,
-                           std::vector<CallInfo>::const_iterator path_end,
+void CallTree::addCallPath(std::vector<const CallInfo *>::const_iterator path_begin,
+                           std::vector<const CallInfo *>::const_iterator path_end,
                            unsigned path_id) {
   //TODO: do we process constraints (what if they are different from the old ones?)
   //TODO: record assumptions for each item in the call-path, because, when
   // comparing two paths in the tree they may differ only by the assumptions.
   if (path_begin == path_end) return;
-  std::vector<CallInfo>::const_iterator next = path_begin;
+  std::vector<const CallInfo *>::const_iterator next = path_begin;
   ++next;
-  std::vector<CallTree*>::iterator i = children.begin(), ie = children.end();
-  for (; i != ie; ++i) {
-    if ((*i)->tip.call.eq(*path_begin)) {
-      (*i)->addCallPath(next, path_end, path_id);
-      return;
-    }
+  if (CallTree *child = findChild(**path_begin)) {
+    child->addCallPath(next, path_end, path_id);
+    return;
   }
+  assert(!dumped && "Extending the call prefix of a finished path.");
   children.push_back(new CallTree());
   CallTree* n = children.back();
-  n->tip.call = *path_begin;
+  n->tip.call = **path_begin;
+  childIndex[n->tip.call.hash()].push_back(n);
   n->tip.path_id = path_id;
   n->addCallPath(next, path_end, path_id);
 }
 
+CallTree *CallTree::findChild(const CallInfo &call) {
+  std::map<unsigned, std::vector<CallTree* > >::iterator it =
+    childIndex.find(call.hash());
+  if (it == childIndex.end()) return 0;
+  std::vector<CallTree*>::iterator i = it->second.begin(),
+    ie = it->second.end();
+  for (; i != ie; ++i) {
+    if ((*i)->tip.call.eq(call))
+      return *i;
+  }
+  return 0;
+}
+
+void CallTree::clearChildren() {
+  std::vector<CallTree*>::iterator i = children.begin(), ie = children.end();
+  for (; i != ie; ++i)
+    delete *i;
+  children.clear();
+  childIndex.clear();
+}
+
 std::vector<std::vector<CallPathTip*> > CallTree::groupChildren() {
   std::vector<std::vector<CallPathTip*> > ret;
+  // The groups by the invocation hash of their calls.
+  std::map<unsigned, std::vector<unsigned> > groupIndex;
   for (unsigned ci = 0; ci < children.size(); ++ci) {
     CallPathTip* current = &children[ci]->tip;
+    std::vector<unsigned> &candidates =
+      groupIndex[current->call.sameInvocationHash()];
     bool groupNotFound = true;
-    for (unsigned gi = 0; gi < ret.size(); ++gi) {
+    for (unsigned i = 0; i < candidates.size(); ++i) {
+      unsigned gi = candidates[i];
       if (current->call.sameInvocation(&ret[gi][0]->call)) {
         ret[gi].push_back(current);
         groupNotFound = false;
@@ -1129,6 +1490,7 @@ std::vector<std::vector<CallPathTip*> > CallTree::groupChildren() {
       }
     }
     if (groupNotFound) {
+      candidates.push_back(ret.size());
       ret.push_back(std::vector<CallPathTip*>());
       ret.back().push_back(current);
     }
@@ -1309,14 +1671,14 @@ void CallTree::dumpCallPrefixes(std::list<CallInfo> accumulated_prefix,
   }
 }
 
-void CallTree::dumpCallPrefixesSExpr(std::list<CallInfo> accumulated_prefix,
-                                     KleeHandler* fileOpener) {
+void CallTree::dumpTipCallsSExpr(const std::list<CallInfo> &accumulated_prefix,
+                                 KleeHandler* fileOpener) {
   std::vector<std::vector<CallPathTip*> > tipCalls = groupChildren();
   std::vector<std::vector<CallPathTip*> >::iterator ti = tipCalls.begin(),
     te = tipCalls.end();
   for (; ti != te; ++ti) {
     llvm::raw_ostream* file = fileOpener->openNextCallPathPrefixFile();
-    std::list<CallInfo>::iterator ai = accumulated_prefix.begin(),
+    std::list<CallInfo>::const_iterator ai = accumulated_prefix.begin(),
       ae = accumulated_prefix.end();
     *file <<"((history (\n";
     for (; ai != ae; ++ai) {
@@ -1335,13 +1697,60 @@ void CallTree::dumpCallPrefixesSExpr(std::list<CallInfo> accumulated_prefix,
     *file <<")))\n";
     delete file;
   }
+}
+
+bool CallTree::dumpFinishedPrefixesSExpr(std::list<CallInfo> &accumulated_prefix,
+                                         const std::set<const CallTree *> &liveNodes,
+                                         const std::set<const CallTree *> &liveSubtrees,
+                                         KleeHandler* fileOpener) {
+  // A live state may still extend any prefix below this one.
+  if (liveSubtrees.count(this)) return false;
+
+  // A live state may still add a new child to this node, but none below
+  // the existing children.
+  bool finished = !liveNodes.count(this);
+  if (finished && !dumped) {
+    dumpTipCallsSExpr(accumulated_prefix, fileOpener);
+    dumped = true;
+  }
   std::vector< CallTree* >::iterator ci = children.begin(),
     ce = children.end();
   for (; ci != ce; ++ci) {
     accumulated_prefix.push_back(( *ci )->tip.call);
-    ( *ci )->dumpCallPrefixesSExpr(accumulated_prefix, fileOpener);
+    bool childFinished =
+      ( *ci )->dumpFinishedPrefixesSExpr(accumulated_prefix, liveNodes,
+                                         liveSubtrees, fileOpener);
     accumulated_prefix.pop_back();
+    // Only keep the tip of a finished child, for the groups of this node.
+    if (childFinished)
+      ( *ci )->clearChildren();
+    finished = finished && childFinished;
   }
+  return finished;
+}
+
+void CallTree::dumpFinishedPrefixesSExpr(const std::vector<std::vector<const CallInfo *> >
+                                         &livePrefixes,
+                                         KleeHandler* fileOpener) {
+  std::set<const CallTree *> liveNodes, liveSubtrees;
+  for (std::vector<std::vector<const CallInfo *> >::const_iterator
+         pi = livePrefixes.begin(), pe = livePrefixes.end(); pi != pe; ++pi) {
+    CallTree *node = this;
+    std::vector<const CallInfo *>::const_iterator i = pi->begin(),
+      ie = pi->end();
+    for (; i != ie; ++i) {
+      CallTree *child = node->findChild(**i);
+      if (!child) break;
+      node = child;
+    }
+    if (i == ie)
+      liveSubtrees.insert(node);
+    else
+      liveNodes.insert(node);
+  }
+  std::list<CallInfo> accumulated_prefix;
+  dumpFinishedPrefixesSExpr(accumulated_prefix, liveNodes, liveSubtrees,
+                            fileOpener);
 }
 
 //===----------------------------------------------------------------------===//
@@ -2213,6 +2622,8 @@ int main(int argc, char **argv, char **envp) {
     }
   }
 
+  handler->flushOutput();
+
   t[1] = time(NULL);
   strftime(buf, sizeof(buf), "Finished: %Y-%m-%d %H:%M:%S\n", localtime(&t[1]));
   handler->getInfoStream() << buf;
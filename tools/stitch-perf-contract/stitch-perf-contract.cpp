@@ -9,16 +9,31 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "klee/CallPath.h"
 #include "klee/ExprBuilder.h"
 #include "klee/perf-contracts.h"
+#include "klee/util/ConstraintSlices.h"
+#include "klee/util/ExprHashMap.h"
+#include "klee/util/ExprPPrinter.h"
 #include "llvm/Support/CommandLine.h"
-#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <dirent.h>
 #include <dlfcn.h>
-#include <expr/Parser.h>
+#include <fcntl.h>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <klee/Constraints.h>
 #include <klee/Solver.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
 #include <vector>
 
 #define DEBUG
@@ -35,225 +50,223 @@ llvm::cl::opt<std::string> UserVariables(
     llvm::cl::desc("Sets the value of user variables (var1=val1,var2=val2)."));
 
 llvm::cl::opt<std::string> InputCallPathFile(llvm::cl::desc("<call path>"),
-                                             llvm::cl::Positional,
-                                             llvm::cl::Required);
+                                             llvm::cl::Positional);
+
+llvm::cl::opt<std::string> CallPathDir(
+    "call-path-dir",
+    llvm::cl::desc("Process every .call_path file in this directory instead "
+                   "of a single call path. Prints path,metric,bound for each "
+                   "path, then all,metric,bound for the maximum."));
+
+llvm::cl::opt<unsigned> Jobs(
+    "jobs", llvm::cl::init(1),
+    llvm::cl::desc("Number of worker processes that process the candidates "
+                   "of a call path. With --call-path-dir, only used when the "
+                   "call paths are processed by a single worker "
+                   "(default=1)."));
+
+llvm::cl::opt<unsigned> Workers(
+    "workers", llvm::cl::init(0),
+    llvm::cl::desc("Number of worker processes that process the call paths "
+                   "of --call-path-dir (default=number of cores)."));
 }
 
-typedef struct {
-  std::string function_name;
-  std::map<std::string, std::pair<klee::ref<klee::Expr>, klee::ref<klee::Expr>>>
-      extra_vars;
-} call_t;
-
-typedef struct {
-  klee::ConstraintManager constraints;
-  std::vector<call_t> calls;
-  std::map<std::string, const klee::Array *> arrays;
-  std::map<std::string, klee::ref<klee::Expr>> initial_extra_vars;
-} call_path_t;
-
-std::map<std::pair<std::string, int>, klee::ref<klee::Expr>>
-    subcontract_constraints;
-
-call_path_t *load_call_path(std::string file_name,
-                            std::set<std::string> symbols,
-                            std::vector<std::string> expressions_str,
-                            std::deque<klee::ref<klee::Expr>> &expressions) {
-  std::ifstream call_path_file(file_name);
-  assert(call_path_file.is_open() && "Unable to open call path file.");
-
-  call_path_t *call_path = new call_path_t;
-
-  enum {
-    STATE_INIT,
-    STATE_KQUERY,
-    STATE_CALLS,
-    STATE_CALLS_MULTILINE,
-    STATE_DONE
-  } state = STATE_INIT;
-
-  std::string kQuery;
-  std::vector<klee::ref<klee::Expr>> exprs;
-  std::set<std::string> declared_arrays;
-
-  int parenthesis_level = 0;
-
-  while (!call_path_file.eof()) {
-    std::string line;
-    std::getline(call_path_file, line);
-
-    switch (state) {
-    case STATE_INIT: {
-      if (line == ";;-- kQuery --") {
-        state = STATE_KQUERY;
-      }
-    } break;
-
-    case STATE_KQUERY: {
-      if (line == ";;-- Calls --") {
-        for (auto ait : symbols) {
-          std::string array_name = ait.substr(sizeof("array "));
-          size_t delim = array_name.find("[");
-          assert(delim != std::string::npos);
-          array_name = array_name.substr(0, delim);
-
-          if (!declared_arrays.count(array_name)) {
-            kQuery = ait + "\n" + kQuery;
-          }
-        }
+// The contract, loaded once and shared by all the call paths.
+std::map<std::string, std::string> user_variables_str;
+std::set<std::string> overriden_user_variables;
+std::map<std::string, std::set<std::string>> optimization_variables_str;
+std::map<std::pair<std::string, int>, std::string> subcontract_constraints_str;
+std::set<std::string> contract_symbols;
+std::vector<std::string> expressions_str;
+
+typedef std::map<std::pair<std::string, int>, klee::ref<klee::Expr>>
+    subcontract_constraints_t;
+
+// The values of the first variables of candidates, in the order of their
+// names, that contradict the call path.
+typedef std::set<std::vector<klee::ref<klee::Expr>>> unsat_prefixes_t;
+
+bool extends_unsat_prefix(
+    const std::map<std::string, klee::ref<klee::Expr>> &vars,
+    const unsat_prefixes_t &unsat_prefixes) {
+  std::vector<klee::ref<klee::Expr>> prefix;
+  for (auto var : vars) {
+    prefix.push_back(var.second);
+    if (unsat_prefixes.count(prefix)) {
+      return true;
+    }
+  }
+  return false;
+}
 
-        assert(kQuery.substr(kQuery.length() - 2) == "])");
-        kQuery = kQuery.substr(0, kQuery.length() - 2) + "\n";
+// What subcontract_may_hold found out for the calls of one call path.
+struct subcontract_memo_t {
+  // The answers for this call path, keyed by the subcontract and its slice
+  // of the constraints, compared structurally.
+  klee::ExprHashMap<bool> queries;
+  unsigned path_hits = 0;
+  unsigned shared_hits = 0;
+  unsigned solved = 0;
+  // The time spent in the solver, in seconds.
+  double solver_time = 0;
+};
+
+// The answers shared by the call paths. The arrays of two call paths are
+// different objects, so the queries are told apart by their kQuery text,
+// which only depends on the names of the arrays. They are bucketed by the
+// hash of the key expression, which does not depend on the array objects
+// either. Cleared when it gets too large. The worker processes pass the
+// answers they solve on through the .memo files of their tasks, see
+// run_in_worker_processes.
+std::map<unsigned, std::vector<std::pair<std::string, bool>>>
+    shared_subcontract_sat_memo;
+size_t shared_subcontract_sat_memo_size = 0;
+const size_t max_shared_subcontract_sat_memo_size = 1 << 16;
+
+// The answers solved by this worker process since its last .memo file.
+bool in_worker_process = false;
+std::vector<std::pair<unsigned, std::pair<std::string, bool>>>
+    new_shared_subcontract_sats;
+
+void add_shared_subcontract_sat(unsigned hash, const std::string &query_str,
+                                bool result) {
+  if (shared_subcontract_sat_memo_size >=
+      max_shared_subcontract_sat_memo_size) {
+    shared_subcontract_sat_memo.clear();
+    shared_subcontract_sat_memo_size = 0;
+  }
+  shared_subcontract_sat_memo[hash].push_back(
+      std::make_pair(query_str, result));
+  shared_subcontract_sat_memo_size++;
+}
 
-        for (auto eit : expressions_str) {
-          kQuery += "\n         " + eit;
-        }
-        kQuery += "])";
-
-        llvm::MemoryBuffer *MB = llvm::MemoryBuffer::getMemBuffer(kQuery);
-        klee::ExprBuilder *Builder = klee::createDefaultExprBuilder();
-        klee::expr::Parser *P =
-            klee::expr::Parser::Create("", MB, Builder, false);
-        while (klee::expr::Decl *D = P->ParseTopLevelDecl()) {
-          assert(!P->GetNumErrors() &&
-                 "Error parsing kquery in call path file.");
-          if (klee::expr::ArrayDecl *AD = dyn_cast<klee::expr::ArrayDecl>(D)) {
-            call_path->arrays[AD->Root->name] = AD->Root;
-          } else if (klee::expr::QueryCommand *QC =
-                         dyn_cast<klee::expr::QueryCommand>(D)) {
-            call_path->constraints = klee::ConstraintManager(QC->Constraints);
-            exprs = QC->Values;
+// Writes the answers solved since the last call, atomically, so that the
+// other processes never read a partial file.
+void write_shared_subcontract_sats(const std::string &file_name) {
+  std::string tmp_name = file_name + ".tmp";
+  {
+    std::ofstream out(tmp_name.c_str());
+    for (auto entry : new_shared_subcontract_sats) {
+      out << entry.first << " " << entry.second.second << " "
+          << entry.second.first.size() << std::endl
+          << entry.second.first << std::endl;
+    }
+    out << "end" << std::endl;
+    if (!out.good()) {
+      unlink(tmp_name.c_str());
+      return;
+    }
+  }
+  new_shared_subcontract_sats.clear();
+  rename(tmp_name.c_str(), file_name.c_str());
+}
+
+// Adds the answers of a file of write_shared_subcontract_sats to the
+// memo. Returns false if there is no such file yet.
+bool load_shared_subcontract_sats(const std::string &file_name) {
+  std::ifstream in(file_name.c_str());
+  if (!in.good()) {
+    return false;
+  }
+  std::vector<std::pair<unsigned, std::pair<std::string, bool>>> entries;
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line == "end") {
+      for (auto entry : entries) {
+        bool known = false;
+        for (auto known_entry : shared_subcontract_sat_memo[entry.first]) {
+          if (known_entry.first == entry.second.first) {
+            known = true;
             break;
           }
         }
-
-        state = STATE_CALLS;
-      } else {
-        kQuery += "\n" + line;
-
-        if (line.substr(0, sizeof("array ") - 1) == "array ") {
-          std::string array_name = line.substr(sizeof("array "));
-          size_t delim = array_name.find("[");
-          assert(delim != std::string::npos);
-          array_name = array_name.substr(0, delim);
-          declared_arrays.insert(array_name);
+        if (!known) {
+          add_shared_subcontract_sat(entry.first, entry.second.first,
+                                     entry.second.second);
         }
       }
+      return true;
+    }
+    unsigned hash;
+    int result;
+    size_t size;
+    if (sscanf(line.c_str(), "%u %d %zu", &hash, &result, &size) != 3) {
       break;
-
-    case STATE_CALLS:
-      if (line == ";;-- Constraints --") {
-        for (size_t i = 0; i < expressions_str.size(); i++) {
-          assert(!exprs.empty() && "Too few expressions in kQuery.");
-          expressions.push_back(exprs.front());
-          exprs.erase(exprs.begin());
-        }
-
-        assert(exprs.empty() && "Too many expressions in kQuery.");
-
-        state = STATE_DONE;
-      } else {
-        size_t delim = line.find(":");
-        assert(delim != std::string::npos);
-        std::string preamble = line.substr(0, delim);
-        line = line.substr(delim + 1);
-
-        if (preamble == "extra") {
-          while (line[0] == ' ') {
-            line = line.substr(1);
-          }
-
-          delim = line.find("&");
-          assert(delim != std::string::npos);
-          std::string name = line.substr(0, delim);
-
-          assert(exprs.size() >= 2 && "Not enough expression in kQuery.");
-          call_path->calls.back().extra_vars[name] =
-              std::make_pair(exprs[0], exprs[1]);
-          if (!call_path->initial_extra_vars.count(name)) {
-            call_path->initial_extra_vars[name] = exprs[0];
-          }
-          exprs.erase(exprs.begin(), exprs.begin() + 2);
-        } else {
-          call_path->calls.emplace_back();
-
-          delim = line.find("(");
-          assert(delim != std::string::npos);
-          call_path->calls.back().function_name = line.substr(0, delim);
-        }
-
-        for (char c : line) {
-          if (c == '(') {
-            parenthesis_level++;
-          } else if (c == ')') {
-            parenthesis_level--;
-            assert(parenthesis_level >= 0);
-          }
-        }
-
-        if (parenthesis_level > 0) {
-          state = STATE_CALLS_MULTILINE;
-        }
-      }
-    } break;
-
-    case STATE_CALLS_MULTILINE: {
-      for (char c : line) {
-        if (c == '(') {
-          parenthesis_level++;
-        } else if (c == ')') {
-          parenthesis_level--;
-          assert(parenthesis_level >= 0);
-        }
-      }
-
-      if (parenthesis_level == 0) {
-        state = STATE_CALLS;
-      }
-
-      continue;
-    } break;
-
-    case STATE_DONE: {
-      continue;
-    } break;
-
-    default: { assert(false && "Invalid call path file."); } break;
     }
+    std::string query_str(size, '\0');
+    if (!in.read(&query_str[0], size) || in.get() != '\n') {
+      break;
+    }
+    entries.push_back(
+        std::make_pair(hash, std::make_pair(query_str, result != 0)));
   }
-
-  return call_path;
+  // Not written by write_shared_subcontract_sats, ignore it.
+  return true;
 }
 
-std::map<std::string, long>
-process_candidate(call_path_t *call_path, void *contract,
-                  std::map<std::string, klee::ref<klee::Expr>> vars) {
-  LOAD_SYMBOL(contract, contract_get_metrics);
-  LOAD_SYMBOL(contract, contract_has_contract);
-  LOAD_SYMBOL(contract, contract_num_sub_contracts);
-  LOAD_SYMBOL(contract, contract_get_subcontract_constraints);
-  LOAD_SYMBOL(contract, contract_get_sub_contract_performance);
+// Whether a subcontract may hold with the call constraints, that is the
+// initial constraints of the call path, indexed by the constraint slices,
+// plus the extra constraints of the candidate and of the call.
+bool subcontract_may_hold(klee::Solver *solver,
+                          klee::ConstraintSlices &constraint_slices,
+                          const klee::ConstraintManager &initial_constraints,
+                          const std::vector<klee::ref<klee::Expr>> &extra,
+                          const klee::ConstraintManager &call_constraints,
+                          klee::ref<klee::Expr> subcontract,
+                          subcontract_memo_t &memo) {
+  std::vector<klee::ref<klee::Expr>> slice = constraint_slices.getSlice(
+      initial_constraints, klee::GetExprSymbols::visit(subcontract), extra);
+
+  klee::ref<klee::Expr> key = subcontract;
+  for (auto it = slice.rbegin(); it != slice.rend(); it++) {
+    key = klee::AndExpr::alloc(*it, key);
+  }
+  auto known = memo.queries.find(key);
+  if (known != memo.queries.end()) {
+    memo.path_hits++;
+    return known->second;
+  }
 
-#ifdef DEBUG
-  std::cerr << std::endl;
-  std::cerr << "Debug: Trying candidate with variables:" << std::endl;
-  for (auto vit : vars) {
-    std::cerr << "Debug:   " << vit.first << " = " << std::flush;
-    vit.second->print(llvm::errs());
-    llvm::errs().flush();
-    std::cerr << std::endl;
+  std::string query_str;
+  llvm::raw_string_ostream query_os(query_str);
+  klee::ExprPPrinter::printQuery(query_os, klee::ConstraintManager(slice),
+                                 subcontract);
+  query_os.flush();
+
+  std::vector<std::pair<std::string, bool>> &bucket =
+      shared_subcontract_sat_memo[key->hash()];
+  for (auto entry : bucket) {
+    if (entry.first == query_str) {
+      memo.shared_hits++;
+      memo.queries[key] = entry.second;
+      return entry.second;
+    }
   }
-#endif
 
-  klee::Solver *solver = klee::createCoreSolver(klee::Z3_SOLVER);
-  assert(solver);
-  solver = createCexCachingSolver(solver);
-  solver = createCachingSolver(solver);
-  solver = createIndependentSolver(solver);
+  auto start = std::chrono::steady_clock::now();
+  klee::Query sat_query(call_constraints, subcontract);
+  bool result = false;
+  bool success = solver->mayBeTrue(sat_query, result);
+  assert(success);
+  memo.solver_time += std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+  memo.solved++;
+
+  memo.queries[key] = result;
+  add_shared_subcontract_sat(key->hash(), query_str, result);
+  if (in_worker_process) {
+    new_shared_subcontract_sats.push_back(
+        std::make_pair(key->hash(), std::make_pair(query_str, result)));
+  }
+  return result;
+}
 
+klee::ConstraintManager
+get_initial_constraints(klee::CallPath *call_path,
+                        klee::ExprBuilder *exprBuilder) {
   klee::ConstraintManager constraints = call_path->constraints;
 
-  klee::ExprBuilder *exprBuilder = klee::createDefaultExprBuilder();
   for (auto extra_var : call_path->initial_extra_vars) {
     std::string initial_name = "initial_" + extra_var.first;
 
@@ -273,8 +286,43 @@ process_candidate(call_path_t *call_path, void *contract,
 
     constraints.addConstraint(eq_expr);
   }
+  return constraints;
+}
+
+std::map<std::string, long>
+process_candidate(klee::CallPath *call_path, void *contract,
+                  subcontract_constraints_t &subcontract_constraints,
+                  const klee::ConstraintManager &initial_constraints,
+                  unsat_prefixes_t &unsat_prefixes,
+                  klee::ConstraintSlices &constraint_slices,
+                  subcontract_memo_t &subcontract_memo,
+                  klee::Solver *solver, klee::ExprBuilder *exprBuilder,
+                  std::map<std::string, klee::ref<klee::Expr>> vars) {
+  LOAD_SYMBOL(contract, contract_get_metrics);
+  LOAD_SYMBOL(contract, contract_has_contract);
+  LOAD_SYMBOL(contract, contract_num_sub_contracts);
+  LOAD_SYMBOL(contract, contract_get_subcontract_constraints);
+  LOAD_SYMBOL(contract, contract_get_sub_contract_performance);
+
+#ifdef DEBUG
+  std::cerr << std::endl;
+  std::cerr << "Debug: Trying candidate with variables:" << std::endl;
+  for (auto vit : vars) {
+    std::cerr << "Debug:   " << vit.first << " = " << std::flush;
+    vit.second->print(llvm::errs());
+    llvm::errs().flush();
+    std::cerr << std::endl;
+  }
+#endif
+
+  klee::ConstraintManager constraints = initial_constraints;
+  // The constraints added to the initial ones, which the constraint slices
+  // do not index.
+  std::vector<klee::ref<klee::Expr>> candidate_constraints;
 
+  std::vector<klee::ref<klee::Expr>> prefix;
   for (auto var : vars) {
+    prefix.push_back(var.second);
     if (call_path->initial_extra_vars.count(var.first)) {
       klee::ref<klee::Expr> eq_expr =
           exprBuilder->Eq(var.second, call_path->initial_extra_vars[var.first]);
@@ -291,10 +339,13 @@ process_candidate(call_path_t *call_path, void *contract,
         llvm::errs().flush();
         std::cerr << std::endl;
 #endif
+        // So do all the candidates that bind the same first variables.
+        unsat_prefixes.insert(prefix);
         return {};
       }
 
       constraints.addConstraint(eq_expr);
+      candidate_constraints.push_back(eq_expr);
     } else {
       std::cerr << "Warning: ignoring variable: " << var.first << std::endl;
     }
@@ -323,6 +374,8 @@ process_candidate(call_path_t *call_path, void *contract,
     }
 
     klee::ConstraintManager call_constraints = constraints;
+    std::vector<klee::ref<klee::Expr>> extra_constraints =
+        candidate_constraints;
 
     for (auto extra_var : cit.extra_vars) {
       std::string current_name = "current_" + extra_var.first;
@@ -342,18 +395,19 @@ process_candidate(call_path_t *call_path, void *contract,
           exprBuilder->Eq(read_expr, extra_var.second.first);
 
       call_constraints.addConstraint(eq_expr);
+      extra_constraints.push_back(eq_expr);
     }
 
     bool found_subcontract = false;
     for (int sub_contract_idx = 0;
          sub_contract_idx < contract_num_sub_contracts(cit.function_name);
          sub_contract_idx++) {
-      klee::Query sat_query(call_constraints,
-                            subcontract_constraints[std::make_pair(
-                                cit.function_name, sub_contract_idx)]);
-      bool result = false;
-      bool success = solver->mayBeTrue(sat_query, result);
-      assert(success);
+      bool result = subcontract_may_hold(
+          solver, constraint_slices, initial_constraints, extra_constraints,
+          call_constraints,
+          subcontract_constraints[std::make_pair(cit.function_name,
+                                                 sub_contract_idx)],
+          subcontract_memo);
 
       if (result) {
         assert(!found_subcontract && "Multiple subcontracts match.");
@@ -363,7 +417,7 @@ process_candidate(call_path_t *call_path, void *contract,
         for (auto extra_var : cit.extra_vars) {
           klee::Query expr_query(constraints, extra_var.second.first);
           klee::ref<klee::ConstantExpr> result;
-          success = solver->getValue(expr_query, result);
+          bool success = solver->getValue(expr_query, result);
           assert(success);
 
           variables[extra_var.first] = result->getLimitedValue();
@@ -412,35 +466,18 @@ process_candidate(call_path_t *call_path, void *contract,
   return total_performance;
 }
 
-int main(int argc, char **argv, char **envp) {
-  llvm::cl::ParseCommandLineOptions(argc, argv);
-
-  dlerror();
-  const char *err = NULL;
-  void *contract = dlopen(ContractLib.c_str(), RTLD_NOW);
-  if ((err = dlerror())) {
-    std::cerr << "Error: Unable to load contract plugin " << ContractLib << ": "
-              << err << std::endl;
-    exit(-1);
-  }
-  assert(contract);
-
-  // Get contract symbols
+void load_contract(void *contract) {
   LOAD_SYMBOL(contract, contract_init);
   LOAD_SYMBOL(contract, contract_get_user_variables);
   LOAD_SYMBOL(contract, contract_get_optimization_variables);
   LOAD_SYMBOL(contract, contract_get_symbols);
   LOAD_SYMBOL(contract, contract_get_contracts);
-  LOAD_SYMBOL(contract, contract_has_contract);
   LOAD_SYMBOL(contract, contract_num_sub_contracts);
   LOAD_SYMBOL(contract, contract_get_subcontract_constraints);
-  LOAD_SYMBOL(contract, contract_get_sub_contract_performance);
 
   contract_init();
 
-  std::map<std::string, std::string> user_variables_str =
-      contract_get_user_variables();
-  std::set<std::string> overriden_user_variables;
+  user_variables_str = contract_get_user_variables();
 
   std::string user_variables_param = UserVariables;
   while (!user_variables_param.empty()) {
@@ -470,11 +507,8 @@ int main(int argc, char **argv, char **envp) {
     overriden_user_variables.insert(user_var);
   }
 
-  std::map<std::string, std::set<std::string>> optimization_variables_str =
-      contract_get_optimization_variables();
+  optimization_variables_str = contract_get_optimization_variables();
 
-  std::map<std::pair<std::string, int>, std::string>
-      subcontract_constraints_str;
   for (auto function_name : contract_get_contracts()) {
     for (int sub_contract_idx = 0;
          sub_contract_idx < contract_num_sub_contracts(function_name);
@@ -485,7 +519,8 @@ int main(int argc, char **argv, char **envp) {
     }
   }
 
-  std::vector<std::string> expressions_str;
+  contract_symbols = contract_get_symbols();
+
   for (auto vit : user_variables_str) {
     expressions_str.push_back(vit.second);
   }
@@ -497,10 +532,22 @@ int main(int argc, char **argv, char **envp) {
   for (auto cit : subcontract_constraints_str) {
     expressions_str.push_back(cit.second);
   }
+}
 
+// The contract expressions refer to the arrays of the call path, so they
+// are parsed again with every call path. Processes the candidates whose
+// index is job modulo num_jobs.
+bool process_candidates(const std::string &call_path_file, void *contract,
+                        unsigned job, unsigned num_jobs,
+                        std::map<std::string, long> &max_performance,
+                        std::string &error) {
   std::deque<klee::ref<klee::Expr>> expressions;
-  call_path_t *call_path = load_call_path(
-      InputCallPathFile, contract_get_symbols(), expressions_str, expressions);
+  klee::CallPath *call_path =
+      klee::loadCallPath(call_path_file, contract_symbols, expressions_str,
+                         expressions, error);
+  if (!call_path) {
+    return false;
+  }
 
   std::map<std::string, klee::ref<klee::Expr>> user_variables;
   for (auto vit : user_variables_str) {
@@ -516,6 +563,7 @@ int main(int argc, char **argv, char **envp) {
       expressions.pop_front();
     }
   }
+  subcontract_constraints_t subcontract_constraints;
   for (auto cit : subcontract_constraints_str) {
     assert(!expressions.empty());
     subcontract_constraints[cit.first] = expressions.front();
@@ -541,27 +589,58 @@ int main(int argc, char **argv, char **envp) {
   }
 #endif
 
-  std::map<std::string, long> max_performance;
+  // The candidates share the constraints of the call path and the
+  // subcontracts, so they share the solver caches as well. The caches
+  // refer to the arrays of the call path and go away with it.
+  klee::Solver *solver = klee::createCoreSolver(klee::Z3_SOLVER);
+  assert(solver);
+  solver = createCexCachingSolver(solver);
+  solver = createCachingSolver(solver);
+  solver = createIndependentSolver(solver);
+
+  klee::ExprBuilder *exprBuilder = klee::createDefaultExprBuilder();
+
+  klee::ConstraintManager initial_constraints =
+      get_initial_constraints(call_path, exprBuilder);
+  unsat_prefixes_t unsat_prefixes;
+  // Indexes the initial constraints once, the candidates and the calls
+  // only add a few constraints to them.
+  klee::ConstraintSlices constraint_slices;
+  subcontract_memo_t subcontract_memo;
+
   std::map<std::string, std::set<klee::ref<klee::Expr>>::iterator>::iterator
       pos;
+  unsigned long candidate_idx = 0;
   do {
-    std::map<std::string, klee::ref<klee::Expr>> vars = user_variables;
+    if (candidate_idx++ % num_jobs == job) {
+      std::map<std::string, klee::ref<klee::Expr>> vars = user_variables;
 
-    for (auto it : candidate_iterators) {
-      vars[it.first] = *it.second;
-    }
+      for (auto it : candidate_iterators) {
+        vars[it.first] = *it.second;
+      }
 
-    std::map<std::string, long> performance =
-        process_candidate(call_path, contract, vars);
-    for (auto metric : performance) {
-      assert(metric.second >= 0);
-      if (metric.second > max_performance[metric.first]) {
-        max_performance[metric.first] = metric.second;
+      if (extends_unsat_prefix(vars, unsat_prefixes)) {
+#ifdef DEBUG
+        std::cerr << "Debug: Skipping candidate with UNSAT variables."
+                  << std::endl;
+#endif
+      } else {
+        std::map<std::string, long> performance = process_candidate(
+            call_path, contract, subcontract_constraints, initial_constraints,
+            unsat_prefixes, constraint_slices, subcontract_memo, solver,
+            exprBuilder, vars);
+        for (auto metric : performance) {
+          assert(metric.second >= 0);
+          if (metric.second > max_performance[metric.first]) {
+            max_performance[metric.first] = metric.second;
+          }
+        }
       }
     }
 
     pos = candidate_iterators.begin();
-    while (++(pos->second) == optimization_variables[pos->first].end()) {
+    while (pos != candidate_iterators.end() &&
+           ++(pos->second) == optimization_variables[pos->first].end()) {
       if (++pos == candidate_iterators.end()) {
         break;
       }
@@ -573,6 +652,346 @@ int main(int argc, char **argv, char **envp) {
     }
   } while (pos != candidate_iterators.end());
 
+#ifdef DEBUG
+  std::cerr << "Debug: Subcontract queries: " << subcontract_memo.path_hits
+            << " call path memo hits, " << subcontract_memo.shared_hits
+            << " shared memo hits, " << subcontract_memo.solved
+            << " solved in " << subcontract_memo.solver_time << "s."
+            << std::endl;
+#endif
+
+  delete exprBuilder;
+  delete solver;
+  delete call_path;
+  return true;
+}
+
+// The work of one task of run_in_worker_processes: fills in the bounds
+// found, or the error, and returns false on an error.
+typedef std::function<bool(size_t, std::map<std::string, long> &,
+                           std::string &)>
+    worker_task_t;
+
+void run_in_worker_processes(size_t num_tasks, unsigned num_processes,
+                             worker_task_t task,
+                             std::vector<std::map<std::string, long>> &results,
+                             std::vector<std::string> &errors,
+                             std::vector<char> &loaded);
+
+// Processes the candidates of the call path in num_jobs worker processes.
+bool process_call_path(const std::string &call_path_file, void *contract,
+                       unsigned num_jobs,
+                       std::map<std::string, long> &max_performance,
+                       std::string &error) {
+  if (num_jobs <= 1) {
+    return process_candidates(call_path_file, contract, 0, 1, max_performance,
+                              error);
+  }
+
+  // The maximum does not depend on the order of the candidates, so the
+  // result is the same as with a single job.
+  std::vector<std::map<std::string, long>> performances(num_jobs);
+  std::vector<std::string> errors(num_jobs);
+  std::vector<char> loaded(num_jobs);
+  run_in_worker_processes(
+      num_jobs, num_jobs,
+      [&](size_t job, std::map<std::string, long> &performance,
+          std::string &job_error) {
+        return process_candidates(call_path_file, contract, job, num_jobs,
+                                  performance, job_error);
+      },
+      performances, errors, loaded);
+
+  for (unsigned job = 0; job < num_jobs; job++) {
+    if (!loaded[job]) {
+      error = errors[job];
+      return false;
+    }
+    for (auto metric : performances[job]) {
+      if (metric.second > max_performance[metric.first]) {
+        max_performance[metric.first] = metric.second;
+      }
+    }
+  }
+  return true;
+}
+
+// Writes the result of a task for the parent process. A result without
+// the final "end" line is the one of a worker process that crashed.
+void write_worker_result(const std::string &file_name, bool loaded,
+                         const std::map<std::string, long> &performance,
+                         const std::string &error) {
+  std::ofstream out(file_name.c_str());
+  if (!loaded) {
+    out << "error" << std::endl << error;
+    return;
+  }
+  out << "ok" << std::endl;
+  for (auto metric : performance) {
+    out << metric.second << " " << metric.first << std::endl;
+  }
+  out << "end" << std::endl;
+}
+
+bool read_worker_result(const std::string &file_name,
+                        std::map<std::string, long> &performance,
+                        std::string &error) {
+  std::ifstream in(file_name.c_str());
+  std::string line;
+  if (std::getline(in, line) && line == "error") {
+    std::getline(in, error, '\0');
+    return false;
+  }
+  if (line == "ok") {
+    while (std::getline(in, line)) {
+      if (line == "end") {
+        return true;
+      }
+      size_t space = line.find(' ');
+      performance[line.substr(space + 1)] =
+          std::stol(line.substr(0, space));
+    }
+  }
+  performance.clear();
+  error = "worker process failed";
+  return false;
+}
+
+// Runs the tasks [0, num_tasks) on at most num_processes forked worker
+// processes, each taking the next task until there is none left. The
+// processes share nothing but the index of the next task, so the globals
+// of KLEE, e.g. the statistics and the reference counts of the
+// expressions, need no locking. The results come back through a file per
+// task, and so does the output of the task on stderr, which is copied
+// there in the order of the tasks once they are all done. The subcontract
+// answers solved by a task are written to a .memo file as well, which the
+// workers load before their next tasks, and the parent process once they
+// are all done, for the workers it forks later on.
+void run_in_worker_processes(size_t num_tasks, unsigned num_processes,
+                             worker_task_t task,
+                             std::vector<std::map<std::string, long>> &results,
+                             std::vector<std::string> &errors,
+                             std::vector<char> &loaded) {
+  num_processes = std::min<size_t>(num_processes, num_tasks);
+  if (num_processes <= 1) {
+    for (size_t idx = 0; idx < num_tasks; idx++) {
+      loaded[idx] = task(idx, results[idx], errors[idx]);
+    }
+    return;
+  }
+
+  char dir_template[] = "/tmp/stitch-perf-contract.XXXXXX";
+  std::string error;
+  if (!mkdtemp(dir_template)) {
+    error = "Unable to create a directory for the worker processes.";
+  }
+  void *shared = MAP_FAILED;
+  if (error.empty()) {
+    shared = mmap(NULL, sizeof(std::atomic<size_t>), PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+      error = "Unable to share memory with the worker processes.";
+    }
+  }
+  if (!error.empty()) {
+    for (size_t idx = 0; idx < num_tasks; idx++) {
+      loaded[idx] = false;
+      errors[idx] = error;
+    }
+    return;
+  }
+  std::string dir = dir_template;
+  std::atomic<size_t> *next_task = new (shared) std::atomic<size_t>(0);
+
+  // Not to print the buffered output once more in every worker.
+  std::cout.flush();
+  std::cerr.flush();
+  llvm::errs().flush();
+  fflush(NULL);
+
+  std::vector<pid_t> workers;
+  for (unsigned i = 0; i < num_processes; i++) {
+    pid_t pid = fork();
+    if (pid < 0) {
+      break;
+    }
+    if (pid == 0) {
+      in_worker_process = true;
+      new_shared_subcontract_sats.clear();
+      // The tasks are taken in order, so only the ones before idx may be
+      // done, and all but the last few of them are loaded already.
+      std::vector<char> memo_loaded(num_tasks);
+      size_t first_unloaded = 0;
+      for (size_t idx; (idx = (*next_task)++) < num_tasks;) {
+        for (size_t done = first_unloaded; done < idx; done++) {
+          if (!memo_loaded[done]) {
+            memo_loaded[done] = load_shared_subcontract_sats(
+                dir + "/" + std::to_string(done) + ".memo");
+          }
+        }
+        while (first_unloaded < num_tasks && memo_loaded[first_unloaded]) {
+          first_unloaded++;
+        }
+        std::string prefix = dir + "/" + std::to_string(idx);
+        int err_fd =
+            open((prefix + ".err").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        if (err_fd >= 0) {
+          dup2(err_fd, STDERR_FILENO);
+          close(err_fd);
+        }
+        std::map<std::string, long> performance;
+        std::string task_error;
+        bool task_loaded = task(idx, performance, task_error);
+        std::cerr.flush();
+        llvm::errs().flush();
+        write_worker_result(prefix + ".out", task_loaded, performance,
+                            task_error);
+        write_shared_subcontract_sats(prefix + ".memo");
+        memo_loaded[idx] = true;
+      }
+      fflush(NULL);
+      _exit(0);
+    }
+    workers.push_back(pid);
+  }
+  if (workers.empty()) {
+    // Not even one worker, do it here.
+    for (size_t idx = next_task->load(); idx < num_tasks; idx++) {
+      loaded[idx] = task(idx, results[idx], errors[idx]);
+    }
+    next_task->store(num_tasks);
+  }
+  for (pid_t pid : workers) {
+    int status;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+  }
+
+  for (size_t idx = 0; idx < num_tasks; idx++) {
+    std::string prefix = dir + "/" + std::to_string(idx);
+    if (!workers.empty()) {
+      std::ifstream err((prefix + ".err").c_str());
+      if (err.good()) {
+        std::cerr << err.rdbuf();
+      }
+      loaded[idx] =
+          read_worker_result(prefix + ".out", results[idx], errors[idx]);
+      load_shared_subcontract_sats(prefix + ".memo");
+    }
+    unlink((prefix + ".err").c_str());
+    unlink((prefix + ".out").c_str());
+    unlink((prefix + ".memo").c_str());
+    unlink((prefix + ".memo.tmp").c_str());
+  }
+  rmdir(dir.c_str());
+  next_task->~atomic<size_t>();
+  munmap(shared, sizeof(std::atomic<size_t>));
+}
+
+int process_call_path_dir(void *contract) {
+  std::vector<std::string> call_path_files;
+  DIR *dir = opendir(CallPathDir.c_str());
+  if (!dir) {
+    std::cerr << "Error: Unable to read directory " << CallPathDir << "."
+              << std::endl;
+    return -1;
+  }
+  while (struct dirent *entry = readdir(dir)) {
+    std::string name = entry->d_name;
+    std::string suffix = ".call_path";
+    if (name.size() > suffix.size() &&
+        name.compare(name.size() - suffix.size(), suffix.size(), suffix) ==
+            0) {
+      call_path_files.push_back(CallPathDir + "/" + name);
+    }
+  }
+  closedir(dir);
+  std::sort(call_path_files.begin(), call_path_files.end());
+
+  unsigned num_workers = Workers;
+  if (num_workers == 0) {
+    num_workers = std::max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+  }
+  // The workers already keep the cores busy, forking the jobs of each call
+  // path in them would only parse the call path once more per job.
+  unsigned num_jobs =
+      std::min<size_t>(num_workers, call_path_files.size()) > 1 ? 1 : Jobs;
+
+  // The results are printed afterwards, in the order of the file names.
+  std::vector<std::map<std::string, long>> performances(
+      call_path_files.size());
+  std::vector<std::string> errors(call_path_files.size());
+  std::vector<char> loaded(call_path_files.size());
+  run_in_worker_processes(
+      call_path_files.size(), num_workers,
+      [&](size_t idx, std::map<std::string, long> &performance,
+          std::string &error) {
+        return process_call_path(call_path_files[idx], contract, num_jobs,
+                                 performance, error);
+      },
+      performances, errors, loaded);
+
+  int ret = 0;
+  std::map<std::string, long> max_performance;
+  for (size_t idx = 0; idx < call_path_files.size(); idx++) {
+    if (!loaded[idx]) {
+      std::cerr << "Error: " << call_path_files[idx] << ": " << errors[idx]
+                << std::endl;
+      ret = -1;
+      continue;
+    }
+    if (performances[idx].empty()) {
+      std::cerr << "Warning: No candidate was SAT for " << call_path_files[idx]
+                << "." << std::endl;
+    }
+    for (auto metric : performances[idx]) {
+      std::cout << call_path_files[idx] << "," << metric.first << ","
+                << metric.second << std::endl;
+      if (metric.second > max_performance[metric.first]) {
+        max_performance[metric.first] = metric.second;
+      }
+    }
+  }
+
+  for (auto metric : max_performance) {
+    std::cout << "all," << metric.first << "," << metric.second << std::endl;
+  }
+  return ret;
+}
+
+int main(int argc, char **argv, char **envp) {
+  llvm::cl::ParseCommandLineOptions(argc, argv);
+
+  if (InputCallPathFile.empty() == CallPathDir.empty()) {
+    std::cerr << "Error: Expected either a call path or --call-path-dir."
+              << std::endl;
+    exit(-1);
+  }
+
+  dlerror();
+  const char *err = NULL;
+  void *contract = dlopen(ContractLib.c_str(), RTLD_NOW);
+  if ((err = dlerror())) {
+    std::cerr << "Error: Unable to load contract plugin " << ContractLib << ": "
+              << err << std::endl;
+    exit(-1);
+  }
+  assert(contract);
+
+  load_contract(contract);
+
+  if (!CallPathDir.empty()) {
+    return process_call_path_dir(contract);
+  }
+
+  std::map<std::string, long> max_performance;
+  std::string error;
+  if (!process_call_path(InputCallPathFile, contract, Jobs, max_performance,
+                         error)) {
+    std::cerr << "Error: " << error << std::endl;
+    exit(-1);
+  }
+
   if (max_performance.empty()) {
     std::cerr << "Warning: No candidate was SAT." << std::endl;
   }
@@ -0,0 +1,323 @@
+//===-- CallPathTest.cpp ----------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+#include "klee/CallPath.h"
+#include "klee/util/ArrayCache.h"
+#include "../../lib/CallPath/BinaryFormat.h"
+
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdio>
+#include <fstream>
+#include <unistd.h>
+
+using namespace klee;
+
+namespace {
+
+std::string print(const ref<Expr> &e) {
+  std::string s;
+  llvm::raw_string_ostream os(s);
+  e->print(os);
+  return os.str();
+}
+
+void appendVarint(std::string &s, uint64_t value) {
+  do {
+    char byte = value & 0x7f;
+    value >>= 7;
+    s += value ? (char)(byte | 0x80) : byte;
+  } while (value);
+}
+
+class CallPathTest : public ::testing::Test {
+protected:
+  ArrayCache ac;
+  const Array *array;
+  ref<Expr> read, updatedRead;
+  std::vector<CallPathCall> calls;
+  ConstraintManager constraints;
+  std::string fileName;
+
+  void SetUp() {
+    array = ac.CreateArray("initial_x", 4);
+    read = ReadExpr::create(UpdateList(array, 0),
+                            ConstantExpr::create(0, Expr::Int32));
+    UpdateList ul(array, 0);
+    ul.extend(ConstantExpr::create(1, Expr::Int32),
+              ConstantExpr::create(7, Expr::Int8));
+    updatedRead = ReadExpr::create(ul, ZExtExpr::create(read, Expr::Int32));
+
+    calls.push_back(CallPathCall());
+    calls.back().function_name = "map_get";
+    calls.back().args["key"].first = AddExpr::create(read, updatedRead);
+    calls.back().args["map"].second = read;
+    calls.back().extra_vars["x"] = std::make_pair(read, updatedRead);
+    constraints.addConstraint(
+        UltExpr::create(read, ConstantExpr::create(100, Expr::Int8)));
+
+    char name[] = "/tmp/CallPathTest.XXXXXX";
+    int fd = mkstemp(name);
+    close(fd);
+    fileName = name;
+  }
+
+  void TearDown() { remove(fileName.c_str()); }
+
+  void writeFile(const std::string &contents) {
+    std::ofstream file(fileName.c_str(), std::ios::binary);
+    file << contents;
+  }
+
+  /// Write a binary call path with one array "a" (w32 -> w8), the given
+  /// expression \a records and no calls nor constraints.
+  void writeRecords(unsigned numRecords, const std::string &records) {
+    std::string contents(callpath::BinaryMagic,
+                         sizeof(callpath::BinaryMagic));
+    appendVarint(contents, callpath::BinaryVersion);
+    appendVarint(contents, 1);
+    appendVarint(contents, 1);
+    contents += "a";
+    appendVarint(contents, 4);
+    appendVarint(contents, Expr::Int32);
+    appendVarint(contents, Expr::Int8);
+    appendVarint(contents, 0);
+    appendVarint(contents, numRecords);
+    contents += records;
+    appendVarint(contents, 0);
+    appendVarint(contents, 0);
+    writeFile(contents);
+  }
+
+  std::string constantRecord(uint64_t width, uint64_t value) {
+    std::string record;
+    appendVarint(record, callpath::ExprRecord);
+    appendVarint(record, Expr::Constant);
+    appendVarint(record, width);
+    for (uint64_t w = 0; w < (width + 63) / 64; ++w)
+      appendVarint(record, w ? 0 : value);
+    return record;
+  }
+
+  std::string exprRecord(Expr::Kind kind, uint64_t op0, uint64_t op1,
+                         uint64_t op2) {
+    std::string record;
+    appendVarint(record, callpath::ExprRecord);
+    appendVarint(record, kind);
+    appendVarint(record, op0);
+    appendVarint(record, op1);
+    if (kind == Expr::Extract)
+      appendVarint(record, op2);
+    return record;
+  }
+
+  std::string updateRecord(uint64_t next, uint64_t index, uint64_t value) {
+    std::string record;
+    appendVarint(record, callpath::UpdateRecord);
+    appendVarint(record, next);
+    appendVarint(record, index);
+    appendVarint(record, value);
+    return record;
+  }
+
+  std::string readRecord(uint64_t updates, uint64_t index) {
+    std::string record;
+    appendVarint(record, callpath::ExprRecord);
+    appendVarint(record, Expr::Read);
+    appendVarint(record, 0);
+    appendVarint(record, updates);
+    appendVarint(record, index);
+    return record;
+  }
+
+  void writeBinary() {
+    std::string contents;
+    llvm::raw_string_ostream os(contents);
+    writeBinaryCallPath(os, calls, constraints);
+    writeFile(os.str());
+  }
+};
+
+TEST_F(CallPathTest, BinaryRoundTrip) {
+  writeBinary();
+  std::string error;
+  CallPath *callPath = loadCallPath(fileName, error);
+  ASSERT_TRUE(callPath) << error;
+
+  ASSERT_EQ(1u, callPath->calls.size());
+  const CallPathCall &call = callPath->calls[0];
+  EXPECT_EQ("map_get", call.function_name);
+  EXPECT_EQ(print(calls[0].args["key"].first),
+            print(call.args.find("key")->second.first));
+  EXPECT_TRUE(call.args.find("key")->second.second.isNull());
+  EXPECT_TRUE(call.args.find("map")->second.first.isNull());
+  EXPECT_EQ(print(updatedRead),
+            print(call.extra_vars.find("x")->second.second));
+  EXPECT_EQ(print(read), print(callPath->initial_extra_vars["x"]));
+
+  ASSERT_EQ(1u, callPath->constraints.size());
+  EXPECT_EQ(print(*constraints.begin()),
+            print(*callPath->constraints.begin()));
+  ASSERT_EQ(1u, callPath->arrays.count("initial_x"));
+  EXPECT_EQ(4u, callPath->arrays["initial_x"]->size);
+  delete callPath;
+}
+
+TEST_F(CallPathTest, BinarySharesSubexpressions) {
+  writeBinary();
+  std::string error;
+  CallPath *callPath = loadCallPath(fileName, error);
+  ASSERT_TRUE(callPath) << error;
+
+  // The read is stored once and loaded as one expression.
+  const CallPathCall &call = callPath->calls[0];
+  EXPECT_EQ(call.args.find("map")->second.second.get(),
+            call.extra_vars.find("x")->second.first.get());
+  EXPECT_EQ(call.args.find("map")->second.second.get(),
+            call.args.find("key")->second.first->getKid(0).get());
+  delete callPath;
+}
+
+TEST_F(CallPathTest, BinaryParsesExpressionsOnTheSameArrays) {
+  writeBinary();
+  std::set<std::string> symbols;
+  symbols.insert("array current_y[4] : w32 -> w8 = symbolic");
+  std::vector<std::string> exprStrs;
+  exprStrs.push_back("(Read w8 0 initial_x)");
+  exprStrs.push_back("(Read w8 0 current_y)");
+  std::deque<ref<Expr> > exprs;
+  std::string error;
+  CallPath *callPath =
+      loadCallPath(fileName, symbols, exprStrs, exprs, error);
+  ASSERT_TRUE(callPath) << error;
+
+  ASSERT_EQ(2u, exprs.size());
+  EXPECT_EQ(callPath->arrays["initial_x"],
+            cast<ReadExpr>(exprs[0])->updates.root);
+  EXPECT_EQ(callPath->arrays["initial_x"],
+            cast<ReadExpr>(callPath->calls[0].extra_vars["x"].first)
+                ->updates.root);
+  EXPECT_EQ(callPath->arrays["current_y"],
+            cast<ReadExpr>(exprs[1])->updates.root);
+  delete callPath;
+}
+
+TEST_F(CallPathTest, TextFormat) {
+  writeFile(";;-- kQuery --\n"
+            "array initial_x[4] : w32 -> w8 = symbolic\n"
+            "(query [(Ult (Read w8 0 initial_x) 100)]\n"
+            "       false [(Read w8 0 initial_x) (Read w8 1 initial_x)])\n"
+            ";;-- Calls --\n"
+            "12:map_get(key:(Read w8 0 initial_x)) -> []\n"
+            "extra: x&1 = &[(Read w8 1 initial_x) -> (...)]\n"
+            ";;-- Constraints --\n");
+  std::string error;
+  CallPath *callPath = loadCallPath(fileName, error);
+  ASSERT_TRUE(callPath) << error;
+
+  ASSERT_EQ(1u, callPath->calls.size());
+  const CallPathCall &call = callPath->calls[0];
+  EXPECT_EQ("map_get", call.function_name);
+  EXPECT_EQ(print(read), print(call.args.find("key")->second.first));
+  EXPECT_TRUE(call.extra_vars.find("x")->second.second.isNull());
+  EXPECT_EQ(1u, callPath->initial_extra_vars.count("x"));
+  EXPECT_EQ(1u, callPath->constraints.size());
+  delete callPath;
+}
+
+TEST_F(CallPathTest, SharedTextFormat) {
+  writeFile(";;-- kQuery --\n"
+            "array initial_x[4] : w32 -> w8 = symbolic\n"
+            "(query [(Ult (Read w8 0 initial_x) 100)]\n"
+            "       false [(Read w8 0 initial_x)])\n"
+            ";;-- Calls --\n"
+            "12:map_get(key:(@0)) -> []\n"
+            "extra: x&1 = &[(@0) -> (...)]\n"
+            ";;-- Constraints --\n");
+  std::string error;
+  CallPath *callPath = loadCallPath(fileName, error);
+  ASSERT_TRUE(callPath) << error;
+
+  ASSERT_EQ(1u, callPath->calls.size());
+  const CallPathCall &call = callPath->calls[0];
+  ref<Expr> key = call.args.find("key")->second.first;
+  EXPECT_EQ(print(read), print(key));
+  EXPECT_EQ(key.get(), call.extra_vars.find("x")->second.first.get());
+  EXPECT_EQ(1u, callPath->constraints.size());
+  delete callPath;
+}
+
+TEST_F(CallPathTest, TruncatedBinary) {
+  std::string contents;
+  llvm::raw_string_ostream os(contents);
+  writeBinaryCallPath(os, calls, constraints);
+  writeFile(os.str().substr(0, os.str().size() - 2));
+
+  std::string error;
+  EXPECT_FALSE(loadCallPath(fileName, error));
+  EXPECT_FALSE(error.empty());
+}
+
+TEST_F(CallPathTest, BinaryChecksWidths) {
+  std::string error;
+  CallPath *callPath;
+
+  writeRecords(3, constantRecord(32, 5) + constantRecord(32, 7) +
+                      exprRecord(Expr::Add, 0, 1, 0));
+  callPath = loadCallPath(fileName, error);
+  EXPECT_TRUE(callPath) << error;
+  delete callPath;
+
+  // Not allocated for.
+  writeRecords(1, constantRecord(1ULL << 40, 5));
+  EXPECT_FALSE(loadCallPath(fileName, error));
+
+  writeRecords(2, constantRecord(8, 5) + exprRecord(Expr::Extract, 0, 4, 8));
+  EXPECT_FALSE(loadCallPath(fileName, error));
+
+  writeRecords(2, constantRecord(8, 5) + exprRecord(Expr::ZExt, 0, 4, 0));
+  EXPECT_FALSE(loadCallPath(fileName, error));
+
+  writeRecords(3, constantRecord(8, 5) + constantRecord(32, 7) +
+                      exprRecord(Expr::Add, 0, 1, 0));
+  EXPECT_FALSE(loadCallPath(fileName, error));
+  EXPECT_FALSE(error.empty());
+}
+
+TEST_F(CallPathTest, BinaryChecksUpdateWidths) {
+  std::string error;
+  CallPath *callPath;
+
+  writeRecords(5, constantRecord(32, 1) + constantRecord(8, 5) +
+                      updateRecord(0, 0, 1) + updateRecord(1, 0, 1) +
+                      readRecord(2, 0));
+  callPath = loadCallPath(fileName, error);
+  EXPECT_TRUE(callPath) << error;
+  delete callPath;
+
+  // The value of the first update is wider than the range of the array.
+  writeRecords(5, constantRecord(32, 1) + constantRecord(8, 5) +
+                      updateRecord(0, 0, 0) + updateRecord(1, 0, 1) +
+                      readRecord(2, 0));
+  EXPECT_FALSE(loadCallPath(fileName, error));
+
+  // The index does not match the domain of the array.
+  writeRecords(4, constantRecord(32, 1) + constantRecord(8, 5) +
+                      updateRecord(0, 1, 1) + readRecord(1, 0));
+  EXPECT_FALSE(loadCallPath(fileName, error));
+  EXPECT_FALSE(error.empty());
+}
+
+TEST_F(CallPathTest, MissingFile) {
+  std::string error;
+  EXPECT_FALSE(loadCallPath("/nonexistent/test.call_path", error));
+  EXPECT_FALSE(error.empty());
+}
+}
@@ -0,0 +1,132 @@
+//===-- ConstraintSlicesTest.cpp ------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/Constraints.h"
+#include "klee/Expr.h"
+#include "klee/util/ArrayCache.h"
+#include "klee/util/ConstraintSlices.h"
+
+using namespace klee;
+
+namespace {
+
+class ConstraintSlicesTest : public ::testing::Test {
+protected:
+  ArrayCache ac;
+  const Array *a, *b, *c, *d;
+  ref<Expr> ra, rb, rc, rd;
+
+  void SetUp() {
+    a = ac.CreateArray("a", 1);
+    b = ac.CreateArray("b", 1);
+    c = ac.CreateArray("c", 1);
+    d = ac.CreateArray("d", 1);
+    ra = Expr::createTempRead(a, 8);
+    rb = Expr::createTempRead(b, 8);
+    rc = Expr::createTempRead(c, 8);
+    rd = Expr::createTempRead(d, 8);
+  }
+
+  static SymbolSet symbols(const Array *array) {
+    SymbolSet result;
+    result.insert(array);
+    return result;
+  }
+};
+
+TEST_F(ConstraintSlicesTest, ConnectedConstraints) {
+  ConstraintManager constraints;
+  ConstraintSlices slices;
+  ref<Expr> c0 = UltExpr::create(ra, ConstantExpr::alloc(10, 8));
+  ref<Expr> c1 = UltExpr::create(rc, ConstantExpr::alloc(5, 8));
+  ref<Expr> c2 = UltExpr::create(rb, rd);
+  constraints.addConstraint(c0);
+  constraints.addConstraint(c1);
+  constraints.addConstraint(c2);
+
+  std::vector<ref<Expr> > slice = slices.getSlice(constraints, symbols(a));
+  ASSERT_EQ(1u, slice.size());
+  EXPECT_EQ(c0, slice[0]);
+
+  // Joins the slices of a and b, in the order of the constraints.
+  ref<Expr> c3 = UltExpr::create(ra, rb);
+  constraints.addConstraint(c3);
+  slice = slices.getSlice(constraints, symbols(d));
+  ASSERT_EQ(3u, slice.size());
+  EXPECT_EQ(c0, slice[0]);
+  EXPECT_EQ(c2, slice[1]);
+  EXPECT_EQ(c3, slice[2]);
+
+  slice = slices.getSlice(constraints, symbols(c));
+  ASSERT_EQ(1u, slice.size());
+  EXPECT_EQ(c1, slice[0]);
+
+  EXPECT_TRUE(slices.getSlice(constraints, SymbolSet()).empty());
+}
+
+TEST_F(ConstraintSlicesTest, ExtraConstraints) {
+  ConstraintManager constraints;
+  ConstraintSlices slices;
+  ref<Expr> c0 = UltExpr::create(ra, ConstantExpr::alloc(10, 8));
+  ref<Expr> c1 = UltExpr::create(rc, ConstantExpr::alloc(5, 8));
+  constraints.addConstraint(c0);
+  constraints.addConstraint(c1);
+
+  // d reaches c only through the extra constraints, which follow the
+  // indexed ones in the slice.
+  std::vector<ref<Expr> > extra;
+  ref<Expr> e0 = UltExpr::create(rb, rc);
+  ref<Expr> e1 = UltExpr::create(rd, rb);
+  extra.push_back(e0);
+  extra.push_back(e1);
+  std::vector<ref<Expr> > slice =
+      slices.getSlice(constraints, symbols(d), extra);
+  ASSERT_EQ(3u, slice.size());
+  EXPECT_EQ(c1, slice[0]);
+  EXPECT_EQ(e0, slice[1]);
+  EXPECT_EQ(e1, slice[2]);
+
+  slice = slices.getSlice(constraints, symbols(a), extra);
+  ASSERT_EQ(1u, slice.size());
+  EXPECT_EQ(c0, slice[0]);
+
+  // The extra constraints were not indexed.
+  EXPECT_TRUE(slices.getSlice(constraints, symbols(d)).empty());
+}
+
+TEST_F(ConstraintSlicesTest, RewrittenConstraints) {
+  ConstraintManager constraints;
+  ConstraintSlices slices;
+  constraints.addConstraint(UltExpr::create(rc, ConstantExpr::alloc(5, 8)));
+  constraints.addConstraint(UltExpr::create(ra, rb));
+  EXPECT_EQ(1u, slices.getSlice(constraints, symbols(c)).size());
+
+  // The equality rewrites the first constraint to true, which is dropped.
+  ref<Expr> eq = EqExpr::create(ConstantExpr::alloc(3, 8), rc);
+  constraints.addConstraint(eq);
+  std::vector<ref<Expr> > slice = slices.getSlice(constraints, symbols(c));
+  ASSERT_EQ(1u, slice.size());
+  EXPECT_EQ(eq, slice[0]);
+  EXPECT_EQ(1u, slices.getSlice(constraints, symbols(b)).size());
+}
+
+TEST_F(ConstraintSlicesTest, ReplacedConstraints) {
+  ConstraintManager constraints;
+  ConstraintSlices slices;
+  constraints.addConstraint(UltExpr::create(ra, rb));
+  EXPECT_EQ(1u, slices.getSlice(constraints, symbols(a)).size());
+
+  constraints = ConstraintManager();
+  constraints.addConstraint(UltExpr::create(rc, rd));
+  EXPECT_TRUE(slices.getSlice(constraints, symbols(a)).empty());
+  EXPECT_EQ(1u, slices.getSlice(constraints, symbols(c)).size());
+}
+}
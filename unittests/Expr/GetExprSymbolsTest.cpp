@@ -0,0 +1,73 @@
+//===-- GetExprSymbolsTest.cpp --------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/Expr.h"
+#include "klee/util/ArrayCache.h"
+#include "klee/util/GetExprSymbols.h"
+
+using namespace klee;
+
+namespace {
+
+TEST(GetExprSymbolsTest, UpdateListValues) {
+  ArrayCache ac;
+  const Array *a = ac.CreateArray("a", 4);
+  const Array *b = ac.CreateArray("b", 1);
+  const Array *c = ac.CreateArray("c", 1);
+  ref<Expr> rb = Expr::createTempRead(b, 8);
+  ref<Expr> rc = Expr::createTempRead(c, 32);
+
+  // a[rc] = rb, then read a[0].
+  UpdateList ul(a, 0);
+  ul.extend(rc, rb);
+  ref<Expr> read = ReadExpr::create(ul, ConstantExpr::alloc(0, Expr::Int32));
+
+  ExprSymbolCache cache(100);
+  SymbolSet symbols = cache.getSymbols(read);
+  EXPECT_EQ(3u, symbols.size());
+  EXPECT_TRUE(symbols.count(a));
+  EXPECT_TRUE(symbols.count(b));
+  EXPECT_TRUE(symbols.count(c));
+
+  // The shared tail of a longer update list is reused.
+  UpdateList longer(ul);
+  longer.extend(ConstantExpr::alloc(1, Expr::Int32), ConstantExpr::alloc(7, 8));
+  ref<Expr> other = ReadExpr::create(longer, rc);
+  EXPECT_EQ(3u, cache.getSymbols(other).size());
+  EXPECT_EQ(3u, GetExprSymbols::visit(other).size());
+}
+
+TEST(GetExprSymbolsTest, SharedSubexpressions) {
+  ArrayCache ac;
+  const Array *a = ac.CreateArray("a", 1);
+  const Array *b = ac.CreateArray("b", 1);
+  ref<Expr> e = Expr::createTempRead(a, 8);
+
+  // Each node is shared twice, a tree walk would visit 2^200 of them.
+  for (unsigned i = 0; i < 200; ++i)
+    e = XorExpr::create(AddExpr::create(e, Expr::createTempRead(b, 8)),
+                        ConstantExpr::alloc(i, 8));
+  for (unsigned i = 0; i < 200; ++i)
+    e = MulExpr::create(e, e);
+
+  ExprSymbolCache cache(100000);
+  SymbolSet symbols = cache.getSymbols(e);
+  EXPECT_EQ(2u, symbols.size());
+  EXPECT_TRUE(symbols.count(a));
+  EXPECT_TRUE(symbols.count(b));
+
+  // Clearing the cache when it is full does not change the result.
+  ExprSymbolCache small(1);
+  EXPECT_EQ(2u, small.getSymbols(e).size());
+  EXPECT_EQ(2u, small.getSymbols(e).size());
+}
+
+}
@@ -0,0 +1,71 @@
+//===-- SharedPrefixListTest.cpp --------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+#include "klee/Internal/ADT/SharedPrefixList.h"
+
+#include <string>
+
+using klee::SharedPrefixList;
+
+namespace {
+
+std::string join(const SharedPrefixList<std::string> &list) {
+  std::string result;
+  std::vector<const std::string *> elements = list.elements();
+  for (unsigned i = 0; i < elements.size(); ++i)
+    result += *elements[i];
+  return result;
+}
+
+TEST(SharedPrefixListTest, Append) {
+  SharedPrefixList<std::string> list;
+  EXPECT_TRUE(list.empty());
+  list.push_back("a");
+  list.push_back("b");
+  EXPECT_EQ(2u, list.size());
+  EXPECT_EQ("b", list.back());
+  EXPECT_EQ("ab", join(list));
+}
+
+TEST(SharedPrefixListTest, CopiesDiverge) {
+  SharedPrefixList<std::string> a;
+  a.push_back("a");
+  a.push_back("b");
+  SharedPrefixList<std::string> b(a);
+  a.push_back("c");
+  b.push_back("d");
+  EXPECT_EQ("abc", join(a));
+  EXPECT_EQ("abd", join(b));
+  // The common prefix is shared, not copied.
+  EXPECT_EQ(a.elements()[1], b.elements()[1]);
+}
+
+TEST(SharedPrefixListTest, ModifySharedBack) {
+  SharedPrefixList<std::string> a;
+  a.push_back("a");
+  SharedPrefixList<std::string> b = a;
+  b.back() += "!";
+  EXPECT_EQ("a", join(a));
+  EXPECT_EQ("a!", join(b));
+  // The back is private now, a second change does not copy it again.
+  const std::string *back = &b.back();
+  b.back() += "!";
+  EXPECT_EQ(back, &b.back());
+  EXPECT_EQ("a!!", join(b));
+}
+
+TEST(SharedPrefixListTest, SelfAssign) {
+  SharedPrefixList<std::string> a;
+  a.push_back("a");
+  a = a;
+  EXPECT_EQ("a", join(a));
+}
+
+}